@@ -3,20 +3,42 @@
 // input data : sent from main program
 layout (location = 0) in vec3 vertexPosition;
 layout (location = 1) in vec3 vertexColor;
+// per-instance translation, left disabled (0,0,0) for non-instanced objects
+layout (location = 2) in vec3 instanceOffset;
 
 uniform mat4 MVP;
+// slot in Transforms to use, or -1 when MVP holds the whole transform
+uniform int TransformIndex;
+
+// filled once per frame by transform_buffer.cpp, sizes must match MAX_TRANSFORMS
+layout (std140) uniform Transforms {
+    mat4 VP;
+    vec4 Translations[1000];
+};
+// int16 positions are stored normalized, this restores their range
+uniform float PositionScale;
 
 // output data : used by fragment shader
 out vec3 fragColor;
 
 void main ()
 {
-    vec4 v = vec4(vertexPosition, 1); // Transform an homogeneous 4D vector
+    vec4 v = vec4(vertexPosition * PositionScale, 1); // Transform an homogeneous 4D vector
 
     // The color of each vertex will be interpolated
     // to produce the color of each fragment
     fragColor = vertexColor;
 
-    // Output position of the vertex, in clip space : MVP * position
-    gl_Position = MVP * v;
+    // Model transform of this instance, identity when not instanced
+    mat4 model = mat4(1.0);
+    model[3] = vec4(instanceOffset, 1);
+
+    mat4 transform = MVP;
+    if (TransformIndex >= 0) {
+        transform = VP;
+        model[3].xyz += Translations[TransformIndex].xyz;
+    }
+
+    // Output position of the vertex, in clip space : MVP * model * position
+    gl_Position = transform * model * v;
 }
@@ -3,6 +3,13 @@
 #include <cstdlib>
 #include <fstream>
 #include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <atomic>
 #include <stdio.h>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -12,6 +19,25 @@
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "gl_state.h"
+#include "vertex_format.h"
+#include "stream_buffer.h"
+#include "transform_buffer.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "occlusion.h"
+#include "offscreen.h"
+#include "occupancy.h"
+#include "triple_buffer.h"
+#include "input_queue.h"
+#include "oscillate.h"
+#include "chunk_store.h"
+#include "chunk_manager.h"
+#include "simulation.h"
+#include "profiler.h"
+#include "gpu_timer.h"
+#include "input_record.h"
+#include "hud.h"
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
 using namespace std;
@@ -21,11 +47,23 @@ using namespace std;
 struct VAO {
 	GLuint VertexArrayID;
 	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+	GLuint ColorBuffer; // 0 when colors are interleaved into VertexBuffer
+	GLuint IndexBuffer; // 0 for unindexed objects
+	GLuint InstanceBuffer; // stream buffer holding per-instance translations, 0 if not instanced
 
 	GLenum PrimitiveMode;
 	GLenum FillMode;
 	int NumVertices;
+	int NumIndices;
+	GLenum IndexType;
+	int MaxInstances;
+
+	int Format; // VERTEX_* layout flags
+	float BoxMin[3], BoxMax[3]; // model space bounds, for culling
+	float PositionScale; // decoded positions are multiplied by this in the shader
+
+	int RefCount; // handles sharing this VAO, see release3DObject
+	struct VAO* Mesh; // shared geometry under an instanced VAO, else NULL
 };
 typedef struct VAO VAO;
 
@@ -37,6 +75,15 @@ struct GLMatrices {
 } Matrices;
 
 GLuint programID;
+StreamBuffer Stream_ring; // per-frame data: instance translations and the Transforms block
+int Transform_ubo=1; // model translations go through the per-frame uniform buffer
+GLuint PositionScaleID;
+GLuint TransformIndexID;
+struct Hud Hud_overlay; // performance overlay, toggled with F1 or --hud
+int Hud_visible=0;
+int Draw_calls=0; // issued so far this frame
+int Fb_width=0, Fb_height=0; // framebuffer size, for the overlay
+int Vertex_format = VERTEX_INTERLEAVED | VERTEX_INDEXED | VERTEX_POS_HALF; // layout used by the scene objects
 
 /* Function to load Shaders - Use it as it is */
 GLuint LoadShaders(const char * vertex_file_path,const char * fragment_file_path) {
@@ -120,31 +167,102 @@ static void error_callback(int error, const char* description)
 	fprintf(stderr, "Error: %s\n", description);
 }
 
+/**************************
+ * Headless backend       *
+ **************************/
+
+int Headless=0; // render offscreen through EGL instead of a GLFW window
+int Frame_limit=600; // headless runs stop after this many frames
+const char* Dump_path=NULL; // headless: write the last frame here as PPM
+vector<double> Frame_times; // headless: seconds per frame
+const char* Trace_path=NULL; // --trace: Chrome trace JSON written on exit
+struct GpuTimer Gpu_timer;
+const char* Record_path=NULL; // --record: input the simulation applied, see input_record.h
+struct InputRecorder Recorder; // written by the simulation thread
+const char* Replay_path=NULL; // --replay: input comes from this recording instead of the keyboard
+struct InputReplay Replay;
+int Replay_fast=0; // --fast: replay ticks back to back instead of at SIM_HZ
+
+/* Seconds since startup; GLFW's clock when there is a window */
+double currentTime ()
+{
+	if (!Headless)
+		return glfwGetTime();
+	static chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+void printFrameStats ()
+{
+	if (Frame_times.empty())
+		return;
+	vector<double> sorted = Frame_times;
+	sort(sorted.begin(), sorted.end());
+	double total = 0;
+	for (size_t i=0; i<sorted.size(); i++)
+		total += sorted[i];
+	size_t n = sorted.size();
+	printf("Headless: %lu frames, mean %.3f ms, median %.3f ms, p99 %.3f ms, max %.3f ms\n", (unsigned long)n,
+		1000.0*total/n, 1000.0*sorted[n/2], 1000.0*sorted[min(n-1, n*99/100)], 1000.0*sorted[n-1]);
+}
+
+void simulationStop ();
+void closeWorld ();
+void releaseObjects ();
+
 void quit(GLFWwindow *window)
 {
+	simulationStop();
+	closeWorld();
+	releaseObjects();
+	if (Record_path != NULL) {
+		int events = Recorder.events;
+		if (recordClose(Recorder, Sim_tick))
+			printf("Recorded %d input events over %ld ticks to %s\n", events, Sim_tick, Record_path);
+		else
+			fprintf(stderr, "Could not write %s\n", Record_path);
+	}
+	if (Record_path != NULL || Replay_path != NULL)
+		printf("State at tick %ld: %016llx\n", Sim_tick, (unsigned long long)simulationHash());
+	if (Trace_path != NULL) {
+		gpuTimerFree(Gpu_timer);
+		if (profileWriteTrace(Trace_path))
+			printf("Trace written to %s (%d GPU results dropped as late)\n", Trace_path, Gpu_timer.dropped);
+		else
+			fprintf(stderr, "Could not write %s\n", Trace_path);
+	}
+	if (Headless) {
+		printFrameStats();
+		if (Dump_path != NULL && !offscreenWritePPM(Dump_path))
+			fprintf(stderr, "Could not write %s\n", Dump_path);
+		offscreenTerminate();
+		exit(EXIT_SUCCESS);
+	}
 	glfwDestroyWindow(window);
 	glfwTerminate();
 	exit(EXIT_SUCCESS);
 }
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
+/* Point attributes 0 and 1 of the bound VAO at its vertex and color VBOs */
+void setup3DObjectAttributes (struct VAO* vao)
 {
-	struct VAO* vao = new struct VAO;
-	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
-	vao->FillMode = fill_mode;
-
-    // Create Vertex Array Object
-    // Should be done after CreateWindow and before any other GL calls
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+    // Enabled arrays and the index buffer are VAO state, so this is done once here instead of per draw
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    if (vao->IndexBuffer != 0)
+        stateBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer);
+
+    if (vao->Format != VERTEX_SEPARATE) {
+        struct VertexLayout layout;
+        vertexLayout(vao->Format, layout);
+        stateBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer);
+        glVertexAttribPointer(0, 3, layout.positionType, layout.positionNormalized, layout.stride, (void*)0);
+        glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, layout.stride, (void*)(size_t)layout.colorOffset);
+        return;
+    }
 
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    stateBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
     glVertexAttribPointer(
                           0,                  // attribute 0. Vertices
                           3,                  // size (x,y,z)
@@ -154,8 +272,7 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
                           (void*)0            // array buffer offset
                           );
 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
+    stateBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
     glVertexAttribPointer(
                           1,                  // attribute 1. Color
                           3,                  // size (r,g,b)
@@ -164,12 +281,149 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
                           0,                  // stride
                           (void*)0            // array buffer offset
                           );
+}
+
+int Mesh_bytes=0; // vertex + index bytes uploaded for meshes
+
+/* Generate VAO, VBOs and return VAO handle - always uploads, no sharing */
+struct VAO* upload3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode, int format)
+{
+	struct VAO* vao = new struct VAO;
+	vao->PrimitiveMode = primitive_mode;
+	vao->NumVertices = numVertices;
+	vao->FillMode = fill_mode;
+	vao->Format = format;
+	vao->PositionScale = 1.0f;
+	vao->IndexBuffer = 0;
+	vao->NumIndices = 0;
+	vao->IndexType = GL_UNSIGNED_SHORT;
+	vao->InstanceBuffer = 0;
+	vao->MaxInstances = 0;
+	vao->RefCount = 1;
+	vao->Mesh = NULL;
+
+	for (int k=0; k<3; k++) {
+		vao->BoxMin[k] = numVertices > 0 ? vertex_buffer_data[k] : 0;
+		vao->BoxMax[k] = vao->BoxMin[k];
+	}
+	for (int i=1; i<numVertices; i++) {
+		for (int k=0; k<3; k++) {
+			vao->BoxMin[k] = min(vao->BoxMin[k], vertex_buffer_data[3*i + k]);
+			vao->BoxMax[k] = max(vao->BoxMax[k], vertex_buffer_data[3*i + k]);
+		}
+	}
+
+    // Create Vertex Array Object
+    // Should be done after CreateWindow and before any other GL calls
+    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
+
+    if (format != VERTEX_SEPARATE) {
+        // One interleaved VBO, plus an index buffer when the vertices were deduplicated
+        struct PackedVertices packed;
+        packVertices(format, numVertices, vertex_buffer_data, color_buffer_data, packed);
+        vao->ColorBuffer = 0;
+        vao->PositionScale = packed.positionScale;
+
+        glGenBuffers (1, &(vao->VertexBuffer));
+        stateBindVertexArray (vao->VertexArrayID);
+        stateBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer);
+        glBufferData (GL_ARRAY_BUFFER, packed.vertices.size(), &packed.vertices[0], GL_STATIC_DRAW);
+        Mesh_bytes += packed.vertices.size();
+
+        if (format & VERTEX_INDEXED) {
+            vao->NumIndices = packed.numIndices;
+            vao->IndexType = packed.indexType;
+            glGenBuffers (1, &(vao->IndexBuffer));
+            stateBindBuffer (GL_ELEMENT_ARRAY_BUFFER, vao->IndexBuffer);
+            glBufferData (GL_ELEMENT_ARRAY_BUFFER, packed.indices.size(), &packed.indices[0], GL_STATIC_DRAW);
+            Mesh_bytes += packed.indices.size();
+        }
+        setup3DObjectAttributes(vao);
+        return vao;
+    }
+
+    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
+    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+
+    stateBindVertexArray (vao->VertexArrayID); // Bind the VAO 
+    stateBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer);
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    stateBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer);
+    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
+    Mesh_bytes += 2*3*numVertices*sizeof(GLfloat);
+    setup3DObjectAttributes(vao);
 
     return vao;
 }
 
+/**************************
+ * Geometry registry      *
+ **************************/
+
+/* Objects with the same vertices, colors and modes share one VAO and one pair of VBOs.
+   Entries are found by a hash of the payload and confirmed against a stored copy. */
+struct MeshEntry {
+	vector<GLfloat> vertices;
+	vector<GLfloat> colors;
+	struct VAO* vao;
+};
+
+unordered_multimap<uint64_t, MeshEntry*> Mesh_registry;
+int Mesh_uploads=0; // distinct meshes currently on the GPU
+
+/* FNV-1a over a byte range, chained through h */
+uint64_t hashBytes (uint64_t h, const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*) data;
+	for (size_t i=0; i<len; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+uint64_t hashMesh (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode, int format)
+{
+	uint64_t h = 14695981039346656037ULL;
+	h = hashBytes(h, &primitive_mode, sizeof(primitive_mode));
+	h = hashBytes(h, &fill_mode, sizeof(fill_mode));
+	h = hashBytes(h, &format, sizeof(format));
+	h = hashBytes(h, &numVertices, sizeof(numVertices));
+	h = hashBytes(h, vertex_buffer_data, 3*numVertices*sizeof(GLfloat));
+	h = hashBytes(h, color_buffer_data, 3*numVertices*sizeof(GLfloat));
+	return h;
+}
+
+/* Return a handle to the VAO holding this geometry, uploading it only the first time */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL, int format=VERTEX_SEPARATE)
+{
+	uint64_t key = hashMesh(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode, format);
+	size_t len = 3*numVertices;
+
+	auto range = Mesh_registry.equal_range(key);
+	for (auto it = range.first; it != range.second; ++it) {
+		MeshEntry* entry = it->second;
+		struct VAO* vao = entry->vao;
+		if (vao->PrimitiveMode == primitive_mode && vao->FillMode == fill_mode && vao->NumVertices == numVertices && vao->Format == format
+			&& equal(entry->vertices.begin(), entry->vertices.end(), vertex_buffer_data)
+			&& equal(entry->colors.begin(), entry->colors.end(), color_buffer_data)) {
+			vao->RefCount++;
+			return vao;
+		}
+	}
+
+	MeshEntry* entry = new MeshEntry;
+	entry->vertices.assign(vertex_buffer_data, vertex_buffer_data + len);
+	entry->colors.assign(color_buffer_data, color_buffer_data + len);
+	entry->vao = upload3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode, format);
+	Mesh_registry.insert(make_pair(key, entry));
+	Mesh_uploads++;
+
+	return entry->vao;
+}
+
 /* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL, int format=VERTEX_SEPARATE)
 {
 	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
 	for (int i=0; i<numVertices; i++) {
@@ -178,30 +432,153 @@ struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloa
 		color_buffer_data [3*i + 2] = blue;
 	}
 
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
+	struct VAO* vao = create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode, format);
+	delete [] color_buffer_data;
+	return vao;
+}
+
+/* Generate a VAO over shared mesh VBOs, with attribute 2 fed one translation per instance from Stream_ring */
+struct VAO* create3DObjectInstanced (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, int maxInstances, GLenum fill_mode=GL_FILL, int format=VERTEX_SEPARATE)
+{
+	// The instance attribute is VAO state, so this one gets its own VAO
+	struct VAO* mesh = create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode, format);
+	struct VAO* vao = new struct VAO;
+	*vao = *mesh;
+	vao->RefCount = 1;
+	vao->Mesh = mesh;
+	vao->MaxInstances = maxInstances;
+
+	glGenVertexArrays(1, &(vao->VertexArrayID));
+	stateBindVertexArray (vao->VertexArrayID);
+	setup3DObjectAttributes(vao);
+
+	vao->InstanceBuffer = Stream_ring.buffer; // the offset is set at every draw
+	stateBindBuffer (GL_ARRAY_BUFFER, vao->InstanceBuffer);
+	glVertexAttribPointer(
+	                      2,                  // attribute 2. Instance translation
+	                      3,                  // size (x,y,z)
+	                      GL_FLOAT,           // type
+	                      GL_FALSE,           // normalized?
+	                      0,                  // stride
+	                      (void*)0            // array buffer offset
+	                      );
+	glEnableVertexAttribArray(2);
+	glVertexAttribDivisor(2, 1); // advance once per instance, not per vertex
+
+	return vao;
+}
+
+/* Drop one reference to a VAO handle, freeing the GPU objects with the last one */
+void release3DObject (struct VAO* vao)
+{
+	if (--vao->RefCount > 0)
+		return;
+
+	if (vao->Mesh != NULL) {
+		// instanced wrapper: own VAO, shared mesh VBOs and stream buffer
+		glDeleteVertexArrays(1, &(vao->VertexArrayID));
+		stateReset(); // deleting a bound object resets its binding behind our back
+		release3DObject(vao->Mesh);
+		delete vao;
+		return;
+	}
+
+	for (auto it = Mesh_registry.begin(); it != Mesh_registry.end(); ++it) {
+		if (it->second->vao == vao) {
+			delete it->second;
+			Mesh_registry.erase(it);
+			Mesh_uploads--;
+			break;
+		}
+	}
+	glDeleteBuffers(1, &(vao->VertexBuffer));
+	if (vao->ColorBuffer != 0)
+		glDeleteBuffers(1, &(vao->ColorBuffer));
+	if (vao->IndexBuffer != 0)
+		glDeleteBuffers(1, &(vao->IndexBuffer));
+	glDeleteVertexArrays(1, &(vao->VertexArrayID));
+	stateReset();
+	delete vao;
+}
+
+/* Upload the int16 position scale only when it differs from the last one set */
+void setPositionScale (float scale)
+{
+	static float current = -1;
+	if (scale == current)
+		return;
+	current = scale;
+	glUniform1f(PositionScaleID, scale);
+}
+
+/* Select the Transforms slot used by the next draws, -1 to use the MVP uniform */
+void setTransformIndex (int index)
+{
+	static int current = -2;
+	if (index == current)
+		return;
+	current = index;
+	glUniform1i(TransformIndexID, index);
 }
 
 /* Render the VBOs handled by VAO */
 void draw3DObject (struct VAO* vao)
 {
+	Draw_calls++;
     // Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+	statePolygonMode (vao->FillMode);
 
-    // Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
+    // Bind the VAO to use - it already holds the enabled attributes and their VBOs
+	stateBindVertexArray (vao->VertexArrayID);
+	setPositionScale (vao->PositionScale);
 
-    // Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+    // Draw the geometry !
+	if (vao->IndexBuffer != 0)
+		glDrawElements(vao->PrimitiveMode, vao->NumIndices, vao->IndexType, (void*)0);
+	else
+		glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+}
 
-    // Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+/* Render numInstances copies of the VAO, each translated by 3 floats from offsets */
+void draw3DObjectInstanced (struct VAO* vao, const GLfloat* offsets, int numInstances)
+{
+	Draw_calls++;
+	if (numInstances > vao->MaxInstances)
+		numInstances = vao->MaxInstances;
+
+	statePolygonMode (vao->FillMode);
+	stateBindVertexArray (vao->VertexArrayID);
+	setPositionScale (vao->PositionScale);
+
+    // Write into this frame's segment of the ring and point attribute 2 at it
+	int orphans = Stream_ring.orphans;
+	size_t offset = streamBufferWrite(Stream_ring, offsets, 3*numInstances*sizeof(GLfloat), sizeof(GLfloat));
+	if (Stream_ring.orphans != orphans && Transform_ubo)
+		transformBufferUpload(Stream_ring); // this draw and the rest need the Transforms block in the new storage
+	stateBindBuffer(GL_ARRAY_BUFFER, vao->InstanceBuffer);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+
+	if (vao->IndexBuffer != 0)
+		glDrawElementsInstanced(vao->PrimitiveMode, vao->NumIndices, vao->IndexType, (void*)0, numInstances);
+	else
+		glDrawArraysInstanced(vao->PrimitiveMode, 0, vao->NumVertices, numInstances);
+}
 
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+/* Same, with the translations already in a buffer of their own (a world chunk) */
+void draw3DObjectInstancedBuffer (struct VAO* vao, GLuint buffer, int numInstances)
+{
+	Draw_calls++;
+	statePolygonMode (vao->FillMode);
+	stateBindVertexArray (vao->VertexArrayID);
+	setPositionScale (vao->PositionScale);
+
+	stateBindBuffer(GL_ARRAY_BUFFER, buffer);
+	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+
+	if (vao->IndexBuffer != 0)
+		glDrawElementsInstanced(vao->PrimitiveMode, vao->NumIndices, vao->IndexType, (void*)0, numInstances);
+	else
+		glDrawArraysInstanced(vao->PrimitiveMode, 0, vao->NumVertices, numInstances);
 }
 
 /**************************
@@ -213,43 +590,70 @@ void draw3DObject (struct VAO* vao)
  bool triangle_rot_status = true;
  bool rectangle_rot_status = true;
 
-float Player_Z =0, Player_X=0, Player_Y=0.0, Player_jump=0;
-
 float camera_rotation_angle = 90;
 float rectangle_rotation = 0;
 float triangle_rotation = 0;
 
+const char* World_path=NULL; // --world: terrain streamed from this file in chunks
+struct ChunkManager Chunks;
+#define CHUNK_VIEW_RADIUS 2 // chunks drawn around the player's chunk in each direction
 
-float Block_flag[20][20]; // for multiplying by (block_move+0.7)
-float Block_flag1[20][20]; // for insert into if condition
-
-float Block_dis_flag[20][20];
-
-float Block_move[20][20];
-float Block_rand=1;
-float obstacles_flag[20][20];
-
-int Block_count=5; 
-
-void check_Pos_X();
-void check_Pos_Z();
-void check_Player_fall();
-void check_player_obstacle();
-
-float u=2.0,t=0,g=1.0,angle=0;
-int Player_fall=0;
-
-float last_update_time , current_time;
+float t=0,angle=0;
 
 int is_dragging=0;
 float x_dragstart,Zoom=1,delta_angle=0;
 float cx=1,cy=1,cz=1,cdx=0,cdy=0,cdz=0,lx=0,ly=0,lz=0,ldx=0,ldy=0,ldz=0,ux=0,uy=1,uz=0,udx=0,udy=0,udz=0;
-int Player_win=0;
+int Instanced_blocks=1; // draw the block grid with one instanced call
+int Frustum_cull=1; // drop grid cells outside the view before queuing them
+int Cull_tested=0, Cull_visible=0; // last frame's culling totals
+int Occlusion_cull=1; // hide cells behind the nearest pillars
+int Occlusion_culled=0; // cells that passed the frustum test but were hidden
+
+/* A block in Block_flag as the renderer sees it */
+struct MovingBlock {
+	int cell; // cellIndex
+	float height, heightPrev; // Block_move now and one tick earlier
+};
+
+/* What the renderer needs from one simulation tick. The simulation thread fills
+   one and publishes it; the main thread only ever reads the latest one. Only
+   what changes every tick is copied, so a tick costs the moving blocks rather
+   than the whole grid. */
+struct WorldSnapshot {
+	double time; // currentTime() when the tick finished
+	float playerX, playerY, playerZ;
+	float playerYPrev; // Player_Y one tick earlier, for interpolation
+	int lost, win;
+	long tick; // Sim_tick
+	int replayEnded; // the replay reached the tick its recording stopped at
+	std::vector<struct MovingBlock> moving; // in cell order
+	unsigned movingVersion; // Blocks_version, changes when a block starts or stops
+	const struct BitGrid* holes; // Block_dis_flag doesn't change after zero(), so it is shared
+	struct BitGrid obstacles; // copied only when the slot's copy is older than Obstacles_version
+	unsigned obstaclesVersion;
+};
+
+struct WorldSnapshot Snapshots[3];
+struct TripleBuffer Snapshot_buffer;
+const struct WorldSnapshot* Latest; // main thread: the snapshot being drawn
+struct InputQueue Input_queue; // key events for the simulation thread
 
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
  void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
  {
+ 	// movement and jumps are applied by the simulation thread, see applyInput
+ 	int command = -1;
+ 	switch (key)
+ 	{
+ 		case GLFW_KEY_UP: command = INPUT_UP; break;
+ 		case GLFW_KEY_DOWN: command = INPUT_DOWN; break;
+ 		case GLFW_KEY_LEFT: command = INPUT_LEFT; break;
+ 		case GLFW_KEY_RIGHT: command = INPUT_RIGHT; break;
+ 		case GLFW_KEY_SPACE: command = INPUT_JUMP; break;
+ 	}
+ 	if (command >= 0)
+ 		inputQueuePush(Input_queue, command, action == GLFW_PRESS ? INPUT_PRESS : action == GLFW_REPEAT ? INPUT_REPEAT : INPUT_RELEASE);
 
  	if (action == GLFW_RELEASE)
  	{
@@ -261,6 +665,38 @@ int Player_win=0;
  			case GLFW_KEY_P:
  			triangle_rot_status = !triangle_rot_status;
  			break;
+ 			case GLFW_KEY_I:
+ 			Instanced_blocks = !Instanced_blocks;
+ 			break;
+ 			case GLFW_KEY_U:
+ 			Transform_ubo = !Transform_ubo;
+ 			break;
+ 			case GLFW_KEY_V:
+ 			Frustum_cull = !Frustum_cull;
+ 			break;
+ 			case GLFW_KEY_O:
+ 			Occlusion_cull = !Occlusion_cull;
+ 			break;
+ 			case GLFW_KEY_G:
+ 			printf("GL state calls last frame: %d issued, %d skipped\n", GL_state_frame.issued, GL_state_frame.skipped);
+ 			printf("Frustum culling last frame: %d of %d cells visible\n", Cull_visible, Cull_tested);
+ 			printf("Occlusion culling last frame: %d cells hidden\n", Occlusion_culled);
+ 			printf("Stream buffer since last report: %d stalls (%.3f ms), %d orphans, %lu bytes\n",
+ 				Stream_ring.stalls, Stream_ring.stallSeconds*1000.0, Stream_ring.orphans, (unsigned long)Stream_ring.bytes);
+ 			Stream_ring.stalls = Stream_ring.orphans = 0;
+ 			Stream_ring.stallSeconds = 0;
+ 			Stream_ring.bytes = 0;
+ 			if(World_store.map != NULL)
+ 			{
+ 				printf("World chunks: %d resident (%lu KB on the GPU), %d loaded, %d rebuilt (%lu KB uploaded) and %d evicted since last report\n",
+ 					(int)Chunks.resident.size(), (unsigned long)(chunkManagerBytes(Chunks)/1024), Chunks.loads, Chunks.rebuilds, (unsigned long)(Chunks.uploaded/1024), Chunks.evictions);
+ 				Chunks.loads = Chunks.evictions = Chunks.rebuilds = 0;
+ 				Chunks.uploaded = 0;
+ 			}
+ 			break;
+ 			case GLFW_KEY_F1:
+ 			Hud_visible = !Hud_visible;
+ 			break;
  			case GLFW_KEY_X:
                 // do something ..
  			break;
@@ -275,22 +711,6 @@ int Player_win=0;
  			case GLFW_KEY_ESCAPE:
  			quit(window);
  			break;
- 			case GLFW_KEY_UP:
- 				Player_Z-=0.2;
-	 			check_Pos_Z();
- 				break;
- 			case GLFW_KEY_DOWN:
- 				Player_Z+=0.2;
-			 	check_Pos_Z();
- 				break;
- 			case GLFW_KEY_LEFT:
- 				Player_X-=0.2;
- 				check_Pos_X();
- 				break;
- 			case GLFW_KEY_RIGHT:
- 				Player_X+=0.2;
- 				check_Pos_X();
- 				break;
  			case GLFW_KEY_Z:
  				Zoom=Zoom+0.2;
  				Matrices.projection = glm::ortho(Zoom*-10.0f, Zoom*10.0f, Zoom*-10.0f, Zoom*10.0f, -10.0f, 10.0f);
@@ -300,10 +720,6 @@ int Player_win=0;
  				Matrices.projection = glm::ortho(Zoom*-10.0f, Zoom*10.0f, Zoom*-10.0f, Zoom*10.0f, -10.0f, 10.0f);
  				break;
 
- 			case GLFW_KEY_SPACE:
- 				Player_jump=1;
- 				check_Player_fall();
- 				break;
  			case GLFW_KEY_T:
  				cdx=-5-cx;
  				cdy=5-cy;
@@ -325,12 +741,12 @@ int Player_win=0;
  				udz=0;
  				break;
  			case GLFW_KEY_F:
- 				cdx=Player_X-2.0;
+ 				cdx=Latest->playerX-2.0;
  				cdy=0.0;
- 				cdz=Player_Z-1;
- 				ldx=Player_X;
- 				ldy=Player_Y;
- 				ldz=Player_Z;
+ 				cdz=Latest->playerZ-1;
+ 				ldx=Latest->playerX;
+ 				ldy=Latest->playerY;
+ 				ldz=Latest->playerZ;
  				udx=0.0;
  				udy=0.0;
  				udz=0;
@@ -341,12 +757,12 @@ int Player_win=0;
  			case GLFW_KEY_H:
 
 
- 				cdx=Player_X-1;
- 				cdy=Player_Y-1;
- 				cdz=Player_Z-1;
- 				ldx=Player_X+10.0;
- 				ldy=Player_Y;
- 				ldz=Player_Z-10;
+ 				cdx=Latest->playerX-1;
+ 				cdy=Latest->playerY-1;
+ 				cdz=Latest->playerZ-1;
+ 				ldx=Latest->playerX+10.0;
+ 				ldy=Latest->playerY;
+ 				ldz=Latest->playerZ-10;
  		
  				break;
 
@@ -361,126 +777,13 @@ int Player_win=0;
  			case GLFW_KEY_ESCAPE:
  			quit(window);
  			break;
- 			case GLFW_KEY_UP:
- 				Player_Z-=0.2;
-	 			check_Pos_Z();
- 				break;
- 			case GLFW_KEY_DOWN:
- 				Player_Z+=0.2;
-			 	check_Pos_Z();
- 				break;
- 			case GLFW_KEY_LEFT:
- 				Player_X-=0.2;
- 				check_Pos_X();
- 				break;
- 			case GLFW_KEY_RIGHT:
- 				Player_X+=0.2;
- 				check_Pos_X();
- 				break;
 
  			default:
  				break;
  		}
- 	} 	
- 	if(Player_X >9.8)
- 		Player_X=9.79;
- 	else if(Player_X <0)
- 		Player_X=0.01;
- 	if(Player_Z >0)
- 		Player_Z=-0.01;
- 	else if(Player_Z <-9.8)
- 		Player_Z=-9.79;
- 	check_Player_fall();
- 	check_player_obstacle();
- 	if(Player_X>=9.5 && Player_Z <=-9.5)
- 	{
- 		Player_win=1;
  	}
- 	// printf("Player_X:   %f  Player_Z:  %f   \n",Player_X,Player_Z);
-
  }
 
-void check_Pos_X()
-{
-	for(int i=0;i<10;i++){
-		for(int j=0;j<10;j++){
-
-			if(Block_flag[i][j]==1)
-			{
-				// printf("Player(X,Z):  (%f,%f)\t BLOCK: (%d,%d)\n",Player_X,Player_Z,i,j);
-				if(Player_X >= i && Player_X <= i+1  &&  Player_Z <= -j && Player_Z >= -(j+1))
-				{
-					// printf("Player_X:  %f , i: %d , Player_Z:  %f  ,  j:  %d \n",Player_X,i,Player_Z,j );
-					if(Player_X < i+0.5)
-						Player_X=Player_X-0.2;
-					else
-						Player_X=Player_X+0.2;
-				}
-			}
-		}
-	}
-}
-
-
-void check_Pos_Z()
-{
-	for(int i=0;i<10;i++)
-	{
-		for(int j=0;j<10;j++)
-		{
-			if(Block_flag[i][j]==1)
-			{
-
-				if(Player_X >= i && Player_X <= i+1  && -(Player_Z) >=j && -(Player_Z) <=j+1)
-				{
-					// printf("Player_X:  %f , i: %d , Player_Z:  %f  ,  j:      ||| 22222222222222222222222%d \n",Player_X,i,Player_Z,j );
-					if(-(Player_Z) < j+0.5)
-						Player_Z=Player_Z+0.2;
-					else
-						Player_Z=Player_Z-0.2;
-				}
-			}
-		}
-	}
-}
-
-
-void check_Player_fall()
-{
-	for(int i=0;i<10;i++)
-	{
-		for(int j=0;j<10;j++)
-		{
-			if(Block_dis_flag[i][j]==1)
-			{
-				// printf("Player(X,Z):  (%f,%f)\t BLOCK: (%d,%d)\n",Player_X,Player_Z,i,j);
-
-				if(Player_X >= i && Player_X <= i+1  && -(Player_Z) >=j && -(Player_Z) <=j+1 && Player_Y <=0.1)
-				{
-					Player_fall=1;
-				}
-				// printf("Player_fall: %d \n",Player_fall);
-			}
-		}
-	}
-}
-
-void check_player_obstacle()
-{
-	for(int i=0;i<10;i++)
-	{
-		for(int j=0;j<10;j++)
-		{
-			if(obstacles_flag[i][j]==1)
-			{
-				if(Player_X >= i && Player_X <= i+1  && -(Player_Z) >=j && -(Player_Z) <=j+1 && Player_Y<=0.1)
-				{
-					Player_fall=1;
-				}				
-			}
-		}
-	}
-}
 
 
 
@@ -539,13 +842,16 @@ void mouse_motion(GLFWwindow* window,double lx,double ly)
  {
  	int fbwidth=width, fbheight=height;
     /* With Retina display on Mac OS X, GLFW's FramebufferSize
-     is different from WindowSize */
- 	glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+     is different from WindowSize; headless runs have no window */
+ 	if (window != NULL)
+ 		glfwGetFramebufferSize(window, &fbwidth, &fbheight);
 
  	GLfloat fov = 90.0f;
 
 	// sets the viewport of openGL renderer
  	glViewport (0, 0, (GLsizei) fbwidth, (GLsizei) fbheight);
+	Fb_width = fbwidth;
+	Fb_height = fbheight;
 
 	// set the projection matrix as perspective
 	/* glMatrixMode (GL_PROJECTION);
@@ -561,10 +867,9 @@ void mouse_motion(GLFWwindow* window,double lx,double ly)
 
 	VAO *triangle, *rectangle, *rectangle6, *circle;
 	VAO *cube1;
-	VAO *Blocks[20][20];
-	VAO *obstacles[20][20];
-	glm::mat4 Block_translate[20][20];
-	glm::mat4 Block_rotate[20][20];
+	VAO *Blocks; // every cell shares one mesh
+	VAO *Blocks_instanced;
+	VAO *obstacles;
 
 void createBlocks (float Block_x, float Block_y, float Block_z, float Block_len, float Block_width, float Block_height)
 	{
@@ -613,13 +918,9 @@ void createBlocks (float Block_x, float Block_y, float Block_z, float Block_len,
     };
 
   // create3DObject creates and returns a handle to a VAO that can be used later
-    for(int i=0;i<10;i++)
-    {
-    	for(int j=0;j<10;j++)
-    	{
-    		Blocks[i][j] = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
-    	}
-    }
+    Blocks = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, color_buffer_data, GL_FILL, Vertex_format);
+    // with a world file only the moving blocks go through it, and draw() grows it to fit them
+    Blocks_instanced = create3DObjectInstanced(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, color_buffer_data, World_store.map != NULL ? 0 : Grid_width*Grid_depth, GL_FILL, Vertex_format);
 }
 
 
@@ -666,13 +967,7 @@ void createobstacles (float Block_x, float Block_y, float Block_z, float Block_l
     };
 
   // create3DObject creates and returns a handle to a VAO that can be used later
-    for(int i=0;i<10;i++)
-    {
-    	for(int j=0;j<10;j++)
-    	{
-    		obstacles[i][j] = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, color_buffer_data, GL_FILL);
-    	}
-    }
+    obstacles = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, color_buffer_data, GL_FILL, Vertex_format);
 }
 
 
@@ -727,7 +1022,7 @@ void createcube (float Block_x, float Block_y, float Block_z, float Block_len, f
 
   // create3DObject creates and returns a handle to a VAO that can be used later
 
-    cube1 = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, 1,0,0);
+    cube1 = create3DObject(GL_TRIANGLE_STRIP, 36, vertex_buffer_data, 1,0,0, GL_FILL, Vertex_format);
 }
 
 
@@ -782,193 +1077,497 @@ void createRectangle ()
 
 
 
-/* Render the scene with openGL */
-/* Edit this function according to your assignment */
-void draw ()
-{
-	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	glUseProgram (programID);
-
-	glm::vec3 eye ( 5*cos(camera_rotation_angle*M_PI/180.0f), 0, 5*sin(camera_rotation_angle*M_PI/180.0f) );
-	glm::vec3 target (0, 0, 0);
-	glm::vec3 up (0, 1, 0);
+RenderQueue Render_queue;
 
+/* Translated copies of grid objects gathered during the frame and culled as one batch */
+struct CullCandidates {
+	CullList boxes;
+	vector<float> pos; // xyz translation per candidate
+	vector<struct VAO*> vaos;
+};
+CullCandidates Block_candidates, Obstacle_candidates;
 
-  Matrices.view = glm::lookAt(glm::vec3(cx+cdx,cy+cdy,cz+cdz), glm::vec3(lx+ldx,ly+ldy,lz+ldz), glm::vec3(ux+udx,uy+udy,uz+udz)); // Fixed camera for 2D (ortho) in XY plane
+void clearCandidates (CullCandidates &c)
+{
+	cullListClear(c.boxes);
+	c.pos.clear();
+	c.vaos.clear();
+}
 
-  glm::mat4 VP = Matrices.projection * Matrices.view;
+void addCandidate (CullCandidates &c, struct VAO* vao, float x, float y, float z)
+{
+	cullListAdd(c.boxes, vao->BoxMin[0]+x, vao->BoxMin[1]+y, vao->BoxMin[2]+z, vao->BoxMax[0]+x, vao->BoxMax[1]+y, vao->BoxMax[2]+z);
+	c.pos.push_back(x);
+	c.pos.push_back(y);
+	c.pos.push_back(z);
+	c.vaos.push_back(vao);
+}
 
-  glm::mat4 MVP;	// MVP = Projection * View * Model
+/* Fill c.boxes.visible, everything counts as visible when culling is off */
+void cullCandidates (CullCandidates &c, const Frustum &frustum)
+{
+	int n = c.vaos.size();
+	int visible = n;
+	if (Frustum_cull)
+		visible = cullListRun(c.boxes, frustum);
+	else
+		c.boxes.visible.assign(n, 1);
+	Cull_tested += n;
+	Cull_visible += visible;
+}
 
+#define OCCLUDER_COUNT 24 // nearest pillars rasterized as occluders each frame
 
-//*************************************background rectangle 1**************************
-  
-//********************moving blocks****************************
+OcclusionBuffer Occlusion_buffer;
 
-   int r1,r2;
-  if(Block_rand == 1)
-	{
-		for(int p=0;p<5;p++)
-		{
+/* Rasterize the visible candidates nearest to the camera into the occlusion buffer */
+void buildOccluders (CullCandidates &c, const glm::mat4 &VP)
+{
+	const float* m = &VP[0][0];
+	CullList &b = c.boxes;
+	vector< pair<float,int> > nearest;
+	for (size_t k=0; k<c.vaos.size(); k++) {
+		if (!b.visible[k])
+			continue;
+		float bmin[3] = {b.minx[k], b.miny[k], b.minz[k]};
+		float bmax[3] = {b.maxx[k], b.maxy[k], b.maxz[k]};
+		nearest.push_back(make_pair(occlusionBoxNearDepth(m, bmin, bmax), (int)k));
+	}
+	size_t count = min(nearest.size(), (size_t)OCCLUDER_COUNT);
+	partial_sort(nearest.begin(), nearest.begin() + count, nearest.end());
+
+	occlusionClear(Occlusion_buffer);
+	for (size_t n=0; n<count; n++) {
+		int k = nearest[n].second;
+		float bmin[3] = {b.minx[k], b.miny[k], b.minz[k]};
+		float bmax[3] = {b.maxx[k], b.maxy[k], b.maxz[k]};
+		occlusionAddBox(Occlusion_buffer, m, bmin, bmax);
+	}
+	occlusionBuildHiZ(Occlusion_buffer);
+}
 
-			r1=rand()%8+1;
-			r2=rand()%8+1;
-			if(Block_flag[r1][r2]==0 && obstacles_flag[r1][r2]==0)
-				Block_flag[r1][r2]=1;
-			else
-				p--;
+/* Clear the visible flag of candidates entirely behind the occluders */
+void occludeCandidates (CullCandidates &c, const glm::mat4 &VP)
+{
+	CullList &b = c.boxes;
+	for (size_t k=0; k<c.vaos.size(); k++) {
+		if (!b.visible[k])
+			continue;
+		float bmin[3] = {b.minx[k], b.miny[k], b.minz[k]};
+		float bmax[3] = {b.maxx[k], b.maxy[k], b.maxz[k]};
+		if (occlusionTestBox(Occlusion_buffer, &VP[0][0], bmin, bmax)) {
+			b.visible[k] = 0;
+			Occlusion_culled++;
 		}
 	}
-	Block_rand = 0;
-
-  for(int i=0;i<10;i++)
-  {
-  	for(int j=0;j<10;j++)
-  	{
-  		
-			// printf("Block_rand: %f\n",Block_rand );
-  		Matrices.model = glm::mat4(1.0f);
-  		Block_translate[i][j]  = glm::translate (glm::vec3(i*1.0, Block_flag[i][j]*(Block_move[i][j]), -j*1.0));
-	  		// Block_rotate[i][j] = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,1,0)); 
-			// Matrices.model *= (Block_translate[i][j]*Block_rotate[i][j]);
-  		Matrices.model *= (Block_translate[i][j]);
-  		MVP = VP * Matrices.model;
-  		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  		if(Block_dis_flag[i][j]==0)
-  			draw3DObject(Blocks[i][j]);
-  		
-  		// if(Block_flag[i][j])
-  		// {
-  		// 	// printf("block_move: %f\n",Block_move[i][j]);
-  		// }
-  		if(Block_flag1[i][j] == 1 && Block_flag[i][j]==1)
-  		{
-  			Block_move[i][j]+=0.01;
-  		}
-  		else if(Block_flag1[i][j] == 0 && Block_flag[i][j]==1)
-  		{
-  			Block_move[i][j]-=0.01;
-  		}
-
-  		// printf("Block_count:   %d\n",Block_count);
-  		if(Block_move[i][j]>=2.0 && Block_flag[i][j]==1)
-  		{
-  			Block_flag1[i][j]=0;
-  		}
-  		else if(Block_move[i][j]<=0.0 && Block_flag[i][j]==1)
-  		{
-  			Block_flag[i][j]=0;
-  			Block_flag1[i][j]=1;
-  			Block_count--;
-  			if(Block_count==0)
-  			{
-  				Block_rand=1;
-  				Block_count=5;
-  			}
-  		}
+}
 
-  	}
-  }	
- //***************************************************************************************
+/* Queue vao translated by (x,y,z) for submitRenderQueue */
+void drawTranslated (struct VAO* vao, const glm::mat4 &VP, float x, float y, float z)
+{
+	RenderItem item;
+	item.vao = vao;
+	item.x = x;
+	item.y = y;
+	item.z = z;
+	// slot -1: buffer full or disabled, falls back to the per-draw MVP
+	item.slot = Transform_ubo ? transformBufferPush(x, y, z) : -1;
+	item.instances = NULL;
+	item.instanceBuffer = 0;
+	item.numInstances = 0;
+
+	glm::vec4 clip = VP * glm::vec4(x, y, z, 1);
+	item.key = renderKey(programID, vao->FillMode, vao->VertexArrayID, clip.z / clip.w);
+	renderQueuePush(Render_queue, item);
+}
 
-//****************************************** CUBE 1 ****************************************
+/* Queue numInstances copies of vao, translated by offsets; the array must live until submission */
+void drawInstanced (struct VAO* vao, const GLfloat* offsets, int numInstances)
+{
+	RenderItem item;
+	item.vao = vao;
+	item.x = item.y = item.z = 0;
+	item.slot = Transform_ubo ? 0 : -1; // slot 0 is VP with no extra translation
+	item.instances = offsets;
+	item.instanceBuffer = 0;
+	item.numInstances = numInstances;
+	item.key = renderKey(programID, vao->FillMode, vao->VertexArrayID, 0);
+	renderQueuePush(Render_queue, item);
+}
 
-  // printf("Player_fall : %d\n",Player_fall );
-  if(Player_fall==1)
-  {
-  	while(1)
-  	{
-  		Player_Y-=0.2;
-  		sleep(0.05);
-  		if(Player_Y<-12.0)
-  			break;  		
-  	}
-  }
+/* Queue an instanced draw whose translations are already in buffer (a world chunk), sorted by depth */
+void drawInstancedBuffer (struct VAO* vao, GLuint buffer, int numInstances, float depth)
+{
+	RenderItem item;
+	item.vao = vao;
+	item.x = item.y = item.z = 0;
+	item.slot = Transform_ubo ? 0 : -1;
+	item.instances = NULL;
+	item.instanceBuffer = buffer;
+	item.numInstances = numInstances;
+	item.key = renderKey(programID, vao->FillMode, vao->VertexArrayID, depth);
+	renderQueuePush(Render_queue, item);
+}
 
-  float x1=Player_X, z1=Player_Z;
-  Matrices.model = glm::mat4(1.0f);
-  glm::mat4 cubetranslate1  = glm::translate (glm::vec3(0+Player_X, Player_Y, 0+Player_Z));
-	  		// Block_rotate[i][j] = glm::rotate((float)(rectangle_rotation*M_PI/180.0f), glm::vec3(0,1,0)); 
-			// Matrices.model *= (Block_translate[i][j]*Block_rotate[i][j]);
-  Matrices.model *= (cubetranslate1);
-  MVP = VP * Matrices.model;
-  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-  draw3DObject(cube1);
+/* Sort the frame's draws by state and issue them, uploading all translations first */
+void submitRenderQueue (const glm::mat4 &VP)
+{
+	if (Transform_ubo)
+		transformBufferUpload(Stream_ring);
+	renderQueueSort(Render_queue);
+
+	for (size_t k=0; k<Render_queue.items.size(); k++) {
+		const RenderItem &item = Render_queue.items[k];
+		setTransformIndex(item.slot);
+		if (item.slot < 0) {
+			Matrices.model = glm::translate (glm::vec3(item.x, item.y, item.z));
+			glm::mat4 MVP = VP * Matrices.model;
+			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+		}
+		if (item.instances != NULL)
+			draw3DObjectInstanced(item.vao, item.instances, item.numInstances);
+		else if (item.instanceBuffer != 0)
+			draw3DObjectInstancedBuffer(item.vao, item.instanceBuffer, item.numInstances);
+		else
+			draw3DObject(item.vao);
+	}
+	renderQueueClear(Render_queue);
+}
 
-//*****************************************************************************
+/**************************
+ * Simulation thread      *
+ **************************/
 
+#define SIM_MAX_FRAME 0.25 // after a stall, drop the time beyond this instead of catching up
 
-//*******************************Obstacles*************************
+float Sim_alpha=0; // main thread: where rendering sits between the previous tick (0) and the latest one (1)
+int Snapshot_last=-1; // simulation thread: the slot published last tick, read for the previous heights
+float Player_Y_prev=0; // Player_Y as of the previous tick
 
+std::thread Sim_thread;
+std::atomic<int> Sim_running(0);
 
-current_time = glfwGetTime();
+float simLerp (float previous, float current)
+{
+	return previous + (current - previous)*Sim_alpha;
+}
 
-if((current_time - last_update_time) >= 10)
+/* Fill the back slot with what the renderer reads and hand it over */
+void publishSnapshot ()
 {
-	for(int i=0;i<10;i++)
+	struct WorldSnapshot &snapshot = Snapshots[Snapshot_buffer.back];
+	snapshot.time = currentTime();
+	snapshot.playerX = Player_X;
+	snapshot.playerY = Player_Y;
+	snapshot.playerZ = Player_Z;
+	snapshot.playerYPrev = Player_Y_prev;
+	snapshot.lost = Player_lost;
+	snapshot.win = Player_win;
+	snapshot.tick = Sim_tick;
+	snapshot.replayEnded = Replay_path != NULL && Sim_tick >= Replay.endTick;
+
+	// the slot published last tick is never the back slot and only the reader
+	// reads it meanwhile; a block missing from it was idle, and idle cells rest at 0
+	static const std::vector<struct MovingBlock> none;
+	const std::vector<struct MovingBlock> &previous = Snapshot_last >= 0 ? Snapshots[Snapshot_last].moving : none;
+	snapshot.moving.resize(Block_cells.size());
+	size_t p=0;
+	for(size_t k=0;k<Block_cells.size();k++)
+	{
+		struct MovingBlock &block = snapshot.moving[k];
+		block.cell = Block_cells[k];
+		block.height = Block_move[k];
+		while(p < previous.size() && previous[p].cell < block.cell)
+			p++;
+		block.heightPrev = (p < previous.size() && previous[p].cell == block.cell) ? previous[p].height : 0;
+	}
+	snapshot.movingVersion = Blocks_version;
+
+	snapshot.holes = &Block_dis_flag;
+	if(snapshot.obstaclesVersion != Obstacles_version)
 	{
-		for(int j=0;j<10;j++)		
-			obstacles_flag[i][j]=0;		
+		snapshot.obstacles = obstacles_flag;
+		snapshot.obstaclesVersion = Obstacles_version;
 	}
+	Snapshot_last = Snapshot_buffer.back;
+	tripleBufferPublish(Snapshot_buffer);
+}
 
-	for(int i=1;i<9;i++)
+/* Tick at SIM_HZ on its own thread, so slow frames and swap stalls don't slow the game down */
+void simulationThread ()
+{
+	profileThreadName("simulation");
+	double next = currentTime();
+	while(Sim_running.load() && !(Replay_path != NULL && Sim_tick >= Replay.endTick))
 	{
-		r1=rand()%2;
-		for(int j=0;j<r1;j++)
+		Player_Y_prev = Player_Y;
+
+		profileBegin("tick");
+		struct InputEvent event;
+		if(Replay_path != NULL)
 		{
-			r2=rand()%8+1;
-			if(Block_dis_flag[i][j]==0 && Block_flag[i][i]==0)
+			while(inputQueuePop(Input_queue, event))
+				; // the keyboard is ignored during a replay
+			while(replayNext(Replay, Sim_tick, event))
+				applyInput(event);
+		}
+		else
+		{
+			while(inputQueuePop(Input_queue, event))
 			{
-				obstacles_flag[i][r2]=1;
+				applyInput(event);
+				recordEvent(Recorder, Sim_tick, event);
 			}
 		}
+		simulationStep();
+		profileEnd();
+		profileBegin("snapshot");
+		publishSnapshot();
+		profileEnd();
+
+		if(Replay_fast)
+			continue;
+		next += SIM_DT;
+		double now = currentTime();
+		if(now - next > SIM_MAX_FRAME)
+			next = now; // too far behind to catch up
+		else if(next > now)
+			this_thread::sleep_for(chrono::duration<double>(next - now));
 	}
-	last_update_time=current_time;
 }
-for(int i=0;i<10;i++)
+
+/* Publish the initial world and start ticking; call after zero() */
+void simulationStart ()
+{
+	tripleBufferInit(Snapshot_buffer);
+	inputQueueInit(Input_queue);
+	Snapshot_last = -1;
+	Player_Y_prev = Player_Y;
+	publishSnapshot();
+	Latest = &Snapshots[tripleBufferAcquire(Snapshot_buffer)];
+	Sim_running.store(1);
+	Sim_thread = std::thread(simulationThread);
+}
+
+void simulationStop ()
 {
-	for(int j=0;j<10;j++)
+	Sim_running.store(0);
+	if(Sim_thread.joinable())
+		Sim_thread.join();
+}
+
+bool cellBefore (const MovingBlock &a, const MovingBlock &b)
+{
+	return a.cell < b.cell;
+}
+
+/* Whether a moving block is drawn at cell (i,j) this frame, in place of its floor block */
+int cellRaised (int i, int j)
+{
+	MovingBlock key;
+	key.cell = cellIndex(i, j);
+	return binary_search(Latest->moving.begin(), Latest->moving.end(), key, cellBefore);
+}
+
+/* Page in the chunks around the player and queue each visible one as an instanced draw from its own buffer */
+void drawChunks (const glm::mat4 &VP, const Frustum &frustum)
+{
+	static CullList boxes;
+	static vector<int> slots;
+	Chunks.raised = cellRaised;
+	Chunks.raisedVersion = Latest->movingVersion;
+	chunkManagerUpdate(Chunks, Latest->playerX, -Latest->playerZ, CHUNK_VIEW_RADIUS);
+
+	cullListClear(boxes);
+	slots.clear();
+	for(size_t s=0;s<Chunks.resident.size();s++)
+	{
+		const ResidentChunk &c = Chunks.resident[s];
+		if(!chunkInView(Chunks, c) || c.instances == 0)
+			continue;
+		float i0 = c.ci*CHUNK_SIZE, i1 = min(c.ci*CHUNK_SIZE+CHUNK_SIZE, Grid_width)-1;
+		float j0 = c.cj*CHUNK_SIZE, j1 = min(c.cj*CHUNK_SIZE+CHUNK_SIZE, Grid_depth)-1;
+		cullListAdd(boxes, Blocks->BoxMin[0]+i0, Blocks->BoxMin[1], Blocks->BoxMin[2]-j1,
+			Blocks->BoxMax[0]+i1, Blocks->BoxMax[1], Blocks->BoxMax[2]-j0);
+		slots.push_back(s);
+	}
+	if(Frustum_cull)
+		cullListRun(boxes, frustum);
+	else
+		boxes.visible.assign(slots.size(), 1);
+
+	for(size_t k=0;k<slots.size();k++)
 	{
-	  Matrices.model = glm::mat4(1.0f);
-	  glm::mat4 cubetranslate2  = glm::translate (glm::vec3(i*1.0, 0, -j*1.0-0.45));
-
-	  Matrices.model *= (cubetranslate2);
-	  MVP = VP * Matrices.model;
-	  glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-	  if(obstacles_flag[i][j]==1)
-	  	draw3DObject(obstacles[i][j]);
+		if(!boxes.visible[k])
+			continue;
+		const ResidentChunk &c = Chunks.resident[slots[k]];
+		// front to back by the chunk centre
+		glm::vec4 clip = VP * glm::vec4(0.5f*(boxes.minx[k]+boxes.maxx[k]), 0, 0.5f*(boxes.minz[k]+boxes.maxz[k]), 1);
+		drawInstancedBuffer(Blocks_instanced, c.buffer, c.instances, clip.z / clip.w);
 	}
 }
 
+/* The overlay goes over the finished scene: per-draw MVP path, no depth test */
+void drawHud ()
+{
+	setTransformIndex (-1);
+	setPositionScale (1.0f);
+	glDisable (GL_DEPTH_TEST);
+	hudDraw (Hud_overlay, Matrices.MatrixID, Fb_width, Fb_height);
+	glEnable (GL_DEPTH_TEST);
+	Draw_calls++;
+}
 
+/* Bytes sent to the GPU since startup, less what the G report reset */
+size_t uploadedBytes ()
+{
+	return Stream_ring.bytes + Chunks.uploaded + Hud_overlay.stream.bytes;
+}
 
+/* Render the scene with openGL */
+/* Edit this function according to your assignment */
+void draw ()
+{
+	stateFrameBegin();
+	Draw_calls = 0;
+	profileBegin("stream wait");
+	streamBufferFrameBegin(Stream_ring);
+	profileEnd();
 
+	gpuTimerBegin(Gpu_timer, "clear");
+	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gpuTimerEnd(Gpu_timer);
 
+	stateUseProgram (programID);
 
-  //*******************************************************************
+  Matrices.view = glm::lookAt(glm::vec3(cx+cdx,cy+cdy,cz+cdz), glm::vec3(lx+ldx,ly+ldy,lz+ldz), glm::vec3(ux+udx,uy+udy,uz+udz)); // Fixed camera for 2D (ortho) in XY plane
 
+  glm::mat4 VP = Matrices.projection * Matrices.view;
 
+  if(Transform_ubo)
+  	transformBufferBegin(VP);
 
+  Frustum frustum;
+  frustumFromMatrix(&VP[0][0], frustum);
+  Cull_tested = Cull_visible = Occlusion_culled = 0;
 
 
+//*************************************background rectangle 1**************************
+  
+//********************moving blocks****************************
 
 
-  // ********************************JUMP ******************************
+  profileBegin("blocks");
+  static vector<GLfloat> Block_offsets;
+  int Block_instances=0;
+  clearCandidates(Block_candidates);
 
-  if(Player_jump==1 && Player_Y >=0.0)
+  if(World_store.map != NULL)
   {
-	Player_Y += (u*t/20.0f - g*t*t/40.0f);
-	t=t+0.05;
+  	// sized by the moving blocks, never the whole world
+  	Block_offsets.resize(3*Latest->moving.size());
+  	if(Blocks_instanced->MaxInstances < (int)Latest->moving.size())
+  		Blocks_instanced->MaxInstances = Latest->moving.size();
+  	// the floor comes from the resident chunks, less the cells a moving block is drawn at,
+  	// so each cell is drawn once at its height as in the in-memory path below
+  	drawChunks(VP, frustum);
+  	for(size_t m=0;m<Latest->moving.size();m++)
+  	{
+  		const MovingBlock &block = Latest->moving[m];
+  		addCandidate(Block_candidates, Blocks, block.cell/Grid_depth*1.0, simLerp(block.heightPrev, block.height), -(block.cell%Grid_depth)*1.0);
+  	}
   }
   else
   {
-  	Player_Y=0.0;
-  	Player_jump=0;
-  	t=0;
+  	Block_offsets.resize(3*Grid_width*Grid_depth);
+  	// only collect the translation, visible cells are queued after the loop;
+  	// the moving blocks are in cell order, so one cursor walks them alongside
+  	size_t m=0;
+  	for(int i=0;i<Grid_width;i++)
+  	{
+  		for(int j=0;j<Grid_depth;j++)
+  		{
+  			int k = cellIndex(i, j);
+  			const MovingBlock* block = (m < Latest->moving.size() && Latest->moving[m].cell == k) ? &Latest->moving[m++] : NULL;
+  			if(!bitGet(*Latest->holes, i, j))
+  			{
+  				float height = block != NULL ? simLerp(block->heightPrev, block->height) : 0;
+  				addCandidate(Block_candidates, Blocks, i*1.0, height, -j*1.0);
+  			}
+  		}
+  	}
   }
 
-// ****************************************************************************************
+  cullCandidates(Block_candidates, frustum);
+  if(Occlusion_cull)
+  {
+  	buildOccluders(Block_candidates, VP);
+  	occludeCandidates(Block_candidates, VP);
+  }
+  for(size_t k=0;k<Block_candidates.vaos.size();k++)
+  {
+  	if(!Block_candidates.boxes.visible[k])
+  		continue;
+  	const float* p = &Block_candidates.pos[3*k];
+  	if(Instanced_blocks)
+  	{
+  		Block_offsets[3*Block_instances] = p[0];
+  		Block_offsets[3*Block_instances + 1] = p[1];
+  		Block_offsets[3*Block_instances + 2] = p[2];
+  		Block_instances++;
+  	}
+  	else
+  		drawTranslated(Block_candidates.vaos[k], VP, p[0], p[1], p[2]);
+  }
+
+  // model transform is built per instance in the vertex shader
+  if(Instanced_blocks && Block_instances > 0)
+  	drawInstanced(Blocks_instanced, &Block_offsets[0], Block_instances);
+  profileEnd();
+ //***************************************************************************************
+
+//****************************************** CUBE 1 ****************************************
+
+  profileBegin("cube");
+  drawTranslated(cube1, VP, 0+Latest->playerX, simLerp(Latest->playerYPrev, Latest->playerY), 0+Latest->playerZ);
+  profileEnd();
+
+//*****************************************************************************
+
+//*******************************Obstacles*************************
+
+profileBegin("obstacles");
+clearCandidates(Obstacle_candidates);
+for(int i=0;i<Grid_width;i++)
+{
+	int fi, j=0;
+	for(;bitGridFind(Latest->obstacles, i, i, j, Grid_depth-1, &fi, &j);j++)
+	  	addCandidate(Obstacle_candidates, obstacles, i*1.0, 0, -j*1.0-0.45);
+}
+cullCandidates(Obstacle_candidates, frustum);
+if(Occlusion_cull)
+	occludeCandidates(Obstacle_candidates, VP);
+for(size_t k=0;k<Obstacle_candidates.vaos.size();k++)
+{
+	const float* p = &Obstacle_candidates.pos[3*k];
+	if(Obstacle_candidates.boxes.visible[k])
+		drawTranslated(Obstacle_candidates.vaos[k], VP, p[0], p[1], p[2]);
+}
+profileEnd();
+
+  // everything queued above reaches GL here, so this is where the GPU time goes
+  gpuTimerBegin(Gpu_timer, "submit");
+  submitRenderQueue(VP);
+  gpuTimerEnd(Gpu_timer);
+  if(Hud_visible)
+  {
+  	gpuTimerBegin(Gpu_timer, "hud");
+  	drawHud();
+  	gpuTimerEnd(Gpu_timer);
+  }
+  profileBegin("fence");
+  streamBufferFrameEnd(Stream_ring);
+  profileEnd();
 }
 
 
@@ -1031,17 +1630,29 @@ void initGL (GLFWwindow* window, int width, int height)
 	createTriangle (); // Generate the VAO, VBOs, vertices data & copy into the array buffer
 	createRectangle ();
 
+	streamBufferInit (Stream_ring, 3*64*1024);
+
 	createBlocks(-8.0,-8.0,0.0,1.0,1.00,9.0);
 	createcube(-8.0,1.0,0.55,0.4,0.4,0.8);
 	createobstacles(-8.0,1.0,0.55,1,1,1);
 
 
 	// Create and compile our GLSL program from the shaders
+	printf("Geometry registry: %d distinct meshes uploaded, %d bytes\n", Mesh_uploads, Mesh_bytes);
+	printf("Block oscillation kernel: %s\n", oscillatePathName(oscillatePath()));
+	printf("Frustum culling kernel: %s\n", cullPathName(cullPath()));
+
 	programID = LoadShaders( "Sample_GL.vert", "Sample_GL.frag" );
 	// Get a handle for our "MVP" uniform
 	Matrices.MatrixID = glGetUniformLocation(programID, "MVP");
+	PositionScaleID = glGetUniformLocation(programID, "PositionScale");
+	TransformIndexID = glGetUniformLocation(programID, "TransformIndex");
+	stateUseProgram (programID);
+	setPositionScale (1.0f);
+	setTransformIndex (-1);
+	transformBufferInit (programID);
+	hudInit (Hud_overlay);
 
-	last_update_time = glfwGetTime();
 	
 	reshapeWindow (window, width, height);
 
@@ -1053,43 +1664,28 @@ void initGL (GLFWwindow* window, int width, int height)
 	glDepthFunc (GL_LEQUAL);
 
 }
-void zero()
-{
-	for(int i=0;i<20;i++)
-	{
-		for(int j=0;j<20;j++)
-		{
-			Block_flag[i][j]=0; // for multiplying by (block_move+0.7)
-			Block_flag1[i][j]=1; // for insert into if condition
-			Block_move[i][j]=0;
-			Block_dis_flag[i][j]=0;
-			obstacles_flag[i][j]=0;
-		}
-	}
-	for(int i=1;i<9;i++)
-	{
-		int r1=rand()%3;
-		for(int j=0;j<r1;j++)
-		{
-			int r2=rand()%8+1;
-			if(Block_dis_flag[i][j]==0 && Block_flag[i][i]==0)
-			{
-				obstacles_flag[i][r2]=1;
-			}
-		}
-	}
-		for(int p=0;p<10;p++)
-		{
 
-			int r1=rand()%8+1;
-			int r2=rand()%8+1;
-			if(Block_flag[r1][r2]==0 && obstacles_flag[r1][r2]==0)
-			{
-				Block_dis_flag[r1][r2]=1;
-			}
-		}
-	
+/* Free the resident chunks and unmap the world file, if there is one */
+void closeWorld()
+{
+	if(World_store.map == NULL)
+		return;
+	chunkManagerFree(Chunks);
+	chunkStoreClose(World_store);
+}
 
+/* Drop the handles initGL created; Blocks and Blocks_instanced share one mesh,
+   so the registry should be empty once both are gone */
+void releaseObjects ()
+{
+	release3DObject(Blocks);
+	release3DObject(Blocks_instanced);
+	release3DObject(obstacles);
+	release3DObject(cube1);
+	release3DObject(triangle);
+	release3DObject(rectangle6);
+	if (Mesh_uploads != 0 || !Mesh_registry.empty())
+		fprintf(stderr, "Geometry registry: %d meshes still referenced at exit\n", Mesh_uploads);
 }
 
 int main (int argc, char** argv)
@@ -1097,40 +1693,165 @@ int main (int argc, char** argv)
 	int width = 1920;
 	int height = 1080;
 
-	GLFWwindow* window = initGLFW(width, height);
+	int seeded = 0;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--headless") == 0)
+			Headless = 1;
+		else if (strcmp(argv[i], "--frames") == 0 && i+1 < argc)
+			Frame_limit = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--dump") == 0 && i+1 < argc)
+			Dump_path = argv[++i];
+		else if (strcmp(argv[i], "--grid") == 0 && i+1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &Grid_width, &Grid_depth) != 2 || !gridSizeValid(Grid_width, Grid_depth)) {
+				fprintf(stderr, "--grid takes WIDTHxDEPTH, from %dx%d to %dx%d\n", GRID_MIN, GRID_MIN, GRID_MAX, GRID_MAX);
+				exit(EXIT_FAILURE);
+			}
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+			Seed = strtoull(argv[++i], NULL, 10), seeded = 1;
+		else if (strcmp(argv[i], "--world") == 0 && i+1 < argc)
+			World_path = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc)
+			Trace_path = argv[++i], Profiling = 1;
+		else if (strcmp(argv[i], "--record") == 0 && i+1 < argc)
+			Record_path = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i+1 < argc)
+			Replay_path = argv[++i];
+		else if (strcmp(argv[i], "--fast") == 0)
+			Replay_fast = 1;
+		else if (strcmp(argv[i], "--hud") == 0)
+			Hud_visible = 1;
+		else {
+			fprintf(stderr, "usage: %s [--headless] [--frames N] [--dump frame.ppm] [--seed N] [--grid WxD] [--world file] [--trace trace.json] [--hud]"
+				" [--record input.rec | --replay input.rec [--fast]]\n", argv[0]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (Record_path != NULL && Replay_path != NULL) {
+		fprintf(stderr, "--record and --replay can't be combined\n");
+		exit(EXIT_FAILURE);
+	}
+
+	// a replay brings its own seed and grid
+	if (Replay_path != NULL) {
+		if (!replayLoad(Replay, Replay_path)) {
+			fprintf(stderr, "Could not read the recording %s\n", Replay_path);
+			exit(EXIT_FAILURE);
+		}
+		Seed = Replay.seed, seeded = 1;
+		Grid_width = Replay.width;
+		Grid_depth = Replay.depth;
+		printf("Replaying %s: %lu input events over %ld ticks%s\n", Replay_path, (unsigned long)Replay.events.size(), Replay.endTick,
+			Replay_fast ? ", as fast as possible" : "");
+	}
+
+	if (!seeded)
+		Seed = (uint64_t)chrono::system_clock::now().time_since_epoch().count();
+	printf("Seed: %llu (rerun with --seed %llu for the same layout)\n", (unsigned long long)Seed, (unsigned long long)Seed);
+
+	if (World_path != NULL) {
+		if (!openWorld(World_path)) {
+			fprintf(stderr, "Could not open or create %s\n", World_path);
+			exit(EXIT_FAILURE);
+		}
+		printf("World: %s, %dx%d cells in %dx%d chunks\n", World_path, Grid_width, Grid_depth, World_store.chunksX, World_store.chunksZ);
+		if (Replay_path != NULL && (Grid_width != Replay.width || Grid_depth != Replay.depth)) {
+			fprintf(stderr, "%s is %dx%d but the recording was made on %dx%d\n", World_path, Grid_width, Grid_depth, Replay.width, Replay.depth);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (Record_path != NULL && !recordOpen(Recorder, Record_path, Seed, Grid_width, Grid_depth)) {
+		fprintf(stderr, "Could not create %s\n", Record_path);
+		exit(EXIT_FAILURE);
+	}
+
+	GLFWwindow* window = NULL;
+	if (Headless) {
+		if (!offscreenInit(width, height))
+			exit(EXIT_FAILURE);
+	}
+	else
+		window = initGLFW(width, height);
 
 	initGL (window, width, height);
+	profileThreadName("main");
+	if (Trace_path != NULL)
+		gpuTimerInit(Gpu_timer);
+	if (World_store.map != NULL)
+		chunkManagerInit(Chunks, World_store, CHUNK_VIEW_RADIUS);
 
 	zero();
+	simulationStart();
 
     /* Draw in loop */
-	while (!glfwWindowShouldClose(window)) {
+	int frame = 0;
+	while (Headless ? frame < Frame_limit : !glfwWindowShouldClose(window)) {
+		double frame_start = currentTime();
+		profileBegin("frame");
+
+		// draw the newest tick, placed between it and the one before by how long ago it was published
+		Latest = &Snapshots[tripleBufferAcquire(Snapshot_buffer)];
+		Sim_alpha = min(1.0, max(0.0, (currentTime() - Latest->time) / SIM_DT));
 
         // OpenGL Draw commands
+		profileBegin("draw");
 		draw();
+		profileEnd();
 
         // Swap Frame Buffer in double buffering
 
-		glfwSwapBuffers(window);
-
-		if(Player_fall==1 )
+		profileBegin("swap");
+		if (Headless)
+			offscreenSwap();
+		else
+			glfwSwapBuffers(window);
+		profileEnd();
+		double frame_seconds = currentTime() - frame_start;
+		if (Headless)
+			Frame_times.push_back(frame_seconds);
+
+		// the overlay keeps its history while hidden, so it has a graph as soon as it is shown
+		static long last_tick = 0;
+		static size_t last_uploaded = 0;
+		struct HudStats stats;
+		stats.frameSeconds = frame_seconds;
+		stats.drawCalls = Draw_calls;
+		stats.stateChanges = GL_state_current.issued;
+		stats.bytesUploaded = uploadedBytes() >= last_uploaded ? uploadedBytes() - last_uploaded : uploadedBytes();
+		stats.simTicks = Latest->tick - last_tick;
+		hudRecord(Hud_overlay, stats);
+		last_tick = Latest->tick;
+		last_uploaded = uploadedBytes();
+		gpuTimerFrameEnd(Gpu_timer);
+		frame++;
+
+		// a replay runs on to the tick its recording stopped at, so both end in the same state
+		if(Latest->lost==1 && Replay_path == NULL)
 		{
 			printf("YOU LOST THE MATCH. TRY AGAIN !!!\n\n\n\n\n\n\n\n\n\n");
 			quit(window);
 		}
-		if(Player_win==1)
+		if(Latest->win==1 && Replay_path == NULL)
 		{
 			printf("CONGRATULATIONS YOU WON THE MATCH !!!!\n\n\n\n\n\n\n\n\n\n");
 			quit(window);
 		}
+		if(Latest->replayEnded)
+		{
+			printf("Replay finished\n");
+			quit(window);
+		}
 
         // Poll for Keyboard and mouse events
-		glfwPollEvents();
+		profileBegin("events");
+		if (!Headless)
+			glfwPollEvents();
+		profileEnd();
+		profileEnd(); // frame
 
         // Control based on time (Time based transformation like 5 degrees rotation every 0.5s)
 
     }
 
-    glfwTerminate();
-    exit(EXIT_SUCCESS);
+    quit(window);
 }
@@ -0,0 +1,143 @@
+#include "chunk_manager.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+
+static int64_t chunkKey (int ci, int cj)
+{
+	return ((int64_t)ci << 32) | (uint32_t)cj;
+}
+
+void chunkManagerInit (struct ChunkManager &mgr, const struct ChunkStore &store, int radius)
+{
+	mgr.store = &store;
+	mgr.capacity = 2*(2*radius + 1)*(2*radius + 1);
+	mgr.update = 0;
+	mgr.resident.clear();
+	mgr.slots.clear();
+	mgr.loads = mgr.evictions = mgr.rebuilds = 0;
+	mgr.uploaded = 0;
+	mgr.raised = NULL;
+	mgr.raisedVersion = 0;
+}
+
+/* Upload the translations of the chunk's cells that have a floor block and
+   are not raised */
+static void buildFloor (struct ChunkManager &mgr, struct ResidentChunk &chunk)
+{
+	const struct ChunkStore &store = *mgr.store;
+	const unsigned char* cells = chunkData(store, chunk.ci, chunk.cj);
+	int i0 = chunk.ci*CHUNK_SIZE, j0 = chunk.cj*CHUNK_SIZE;
+	int i1 = std::min(i0 + CHUNK_SIZE, store.width), j1 = std::min(j0 + CHUNK_SIZE, store.depth);
+
+	mgr.scratch.clear();
+	for (int i=i0; i<i1; i++)
+		for (int j=j0; j<j1; j++)
+			if (!(cells[(i - i0)*CHUNK_SIZE + j - j0] & CELL_HOLE) && (mgr.raised == NULL || !mgr.raised(i, j))) {
+				mgr.scratch.push_back(i);
+				mgr.scratch.push_back(0);
+				mgr.scratch.push_back(-j);
+			}
+
+	chunk.instances = mgr.scratch.size() / 3;
+	chunk.raisedVersion = mgr.raisedVersion;
+	size_t bytes = mgr.scratch.size()*sizeof(float);
+	stateBindBuffer(GL_ARRAY_BUFFER, chunk.buffer);
+	glBufferData(GL_ARRAY_BUFFER, bytes, bytes ? &mgr.scratch[0] : NULL, GL_STATIC_DRAW);
+	mgr.uploaded += bytes;
+}
+
+static void loadChunk (struct ChunkManager &mgr, struct ResidentChunk &chunk)
+{
+	glGenBuffers(1, &chunk.buffer);
+	buildFloor(mgr, chunk);
+	mgr.loads++;
+}
+
+static void evictChunk (struct ChunkManager &mgr, int slot)
+{
+	struct ResidentChunk &chunk = mgr.resident[slot];
+	// the name may be handed out again, so the shadow must not think it is still bound
+	stateBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDeleteBuffers(1, &chunk.buffer);
+	chunkStoreRelease(*mgr.store, chunk.ci, chunk.cj);
+	mgr.slots.erase(chunkKey(chunk.ci, chunk.cj));
+	mgr.evictions++;
+
+	// move the last chunk into the hole
+	int last = mgr.resident.size() - 1;
+	if (slot != last) {
+		mgr.resident[slot] = mgr.resident[last];
+		mgr.slots[chunkKey(mgr.resident[slot].ci, mgr.resident[slot].cj)] = slot;
+	}
+	mgr.resident.pop_back();
+}
+
+int chunkManagerUpdate (struct ChunkManager &mgr, float i, float j, int radius)
+{
+	const struct ChunkStore &store = *mgr.store;
+	int pci = (int)floor(i) / CHUNK_SIZE, pcj = (int)floor(j) / CHUNK_SIZE;
+	int ci0 = std::max(0, pci - radius), ci1 = std::min(store.chunksX - 1, pci + radius);
+	int cj0 = std::max(0, pcj - radius), cj1 = std::min(store.chunksZ - 1, pcj + radius);
+	mgr.update++;
+
+	// touch what is already resident, rebuilding floors made before the raised
+	// cells last changed, and collect what is missing
+	std::vector<std::pair<int, int64_t> > missing; // (distance, key)
+	for (int ci=ci0; ci<=ci1; ci++)
+		for (int cj=cj0; cj<=cj1; cj++) {
+			std::unordered_map<int64_t, int>::iterator it = mgr.slots.find(chunkKey(ci, cj));
+			if (it != mgr.slots.end()) {
+				struct ResidentChunk &chunk = mgr.resident[it->second];
+				chunk.lastUsed = mgr.update;
+				if (chunk.raisedVersion != mgr.raisedVersion) {
+					buildFloor(mgr, chunk);
+					mgr.rebuilds++;
+				}
+			}
+			else
+				missing.push_back(std::make_pair(std::max(abs(ci - pci), abs(cj - pcj)), chunkKey(ci, cj)));
+		}
+
+	std::sort(missing.begin(), missing.end());
+	int loaded = std::min((int)missing.size(), CHUNK_LOAD_BUDGET);
+	for (int k=0; k<loaded; k++)
+		chunkStorePrefetch(store, missing[k].second >> 32, (int32_t)missing[k].second);
+	for (int k=0; k<loaded; k++) {
+		struct ResidentChunk chunk;
+		chunk.ci = missing[k].second >> 32;
+		chunk.cj = (int32_t)missing[k].second;
+		chunk.lastUsed = mgr.update;
+		loadChunk(mgr, chunk);
+		mgr.slots[missing[k].second] = mgr.resident.size();
+		mgr.resident.push_back(chunk);
+	}
+
+	// least recently used first; chunks in view are never evicted
+	while ((int)mgr.resident.size() > mgr.capacity) {
+		int oldest = -1;
+		for (size_t s=0; s<mgr.resident.size(); s++)
+			if (mgr.resident[s].lastUsed != mgr.update && (oldest < 0 || mgr.resident[s].lastUsed < mgr.resident[oldest].lastUsed))
+				oldest = s;
+		if (oldest < 0)
+			break;
+		evictChunk(mgr, oldest);
+	}
+	return loaded;
+}
+
+size_t chunkManagerBytes (const struct ChunkManager &mgr)
+{
+	size_t bytes = 0;
+	for (size_t s=0; s<mgr.resident.size(); s++)
+		bytes += 3*sizeof(float)*mgr.resident[s].instances;
+	return bytes;
+}
+
+void chunkManagerFree (struct ChunkManager &mgr)
+{
+	while (!mgr.resident.empty())
+		evictChunk(mgr, mgr.resident.size() - 1);
+}
@@ -0,0 +1,69 @@
+#ifndef CHUNK_MANAGER_H
+#define CHUNK_MANAGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+#include "chunk_store.h"
+
+/* Keeps the chunks around the player resident: a chunk entering the view
+   radius is paged in from the world file and its floor translations are
+   uploaded once into a static buffer; when more than capacity chunks are
+   resident the least recently used one outside the radius is evicted and
+   its buffer and pages released. Memory and upload work are bounded by the
+   radius, not the world size.
+
+   Cells the caller draws itself, raised off the floor, are left out of the
+   floor buffers: set raised to say which, and change raisedVersion whenever
+   its answers change, so chunks in view are rebuilt at the next update. */
+
+#define CHUNK_LOAD_BUDGET 8 // chunks built per update, nearest first, so a teleport doesn't stall a frame
+
+struct ResidentChunk {
+	int ci, cj;
+	GLuint buffer;  // per-instance translations of the chunk's floor cells
+	int instances;
+	int lastUsed;   // update in which the chunk was last inside the radius
+	unsigned raisedVersion; // mgr.raisedVersion when the buffer was built
+};
+
+struct ChunkManager {
+	const struct ChunkStore* store;
+	int capacity;   // resident chunks kept at most
+	int update;     // number of chunkManagerUpdate calls so far
+	std::vector<struct ResidentChunk> resident;
+	std::unordered_map<int64_t, int> slots; // chunk key -> index in resident
+	std::vector<float> scratch;
+	int (*raised)(int i, int j); // NULL when every cell without a hole has a floor block
+	unsigned raisedVersion;
+
+	// counters, accumulated until the caller resets them
+	int loads;
+	int evictions;
+	int rebuilds; // floors rebuilt because the raised cells changed
+	size_t uploaded; // bytes
+};
+
+/* Capacity is the (2*radius+1)^2 chunks in view plus as many again of slack,
+   so walking back and forth over a chunk border doesn't reload anything */
+void chunkManagerInit (struct ChunkManager &mgr, const struct ChunkStore &store, int radius);
+
+/* Page in the chunks within radius chunks of cell position (i, j) and evict
+   beyond capacity; returns how many chunks were loaded */
+int chunkManagerUpdate (struct ChunkManager &mgr, float i, float j, int radius);
+
+/* Whether a resident chunk was inside the radius at the last update */
+inline int chunkInView (const struct ChunkManager &mgr, const struct ResidentChunk &chunk)
+{
+	return chunk.lastUsed == mgr.update;
+}
+
+/* GPU bytes held by the resident chunks */
+size_t chunkManagerBytes (const struct ChunkManager &mgr);
+
+/* Release every resident chunk */
+void chunkManagerFree (struct ChunkManager &mgr);
+
+#endif
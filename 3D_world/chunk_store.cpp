@@ -0,0 +1,116 @@
+#include "chunk_store.h"
+
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char World_magic[8] = {'3','D','W','O','R','L','D','1'};
+
+struct ChunkHeader {
+	char magic[8];
+	int32_t width, depth;
+	int32_t chunkSize;
+};
+
+static void setSize (struct ChunkStore &store, int width, int depth)
+{
+	store.width = width;
+	store.depth = depth;
+	store.chunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	store.chunksZ = (depth + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	store.size = CHUNK_HEADER_BYTES + (size_t)store.chunksX*store.chunksZ*CHUNK_BYTES;
+}
+
+static int mapFile (struct ChunkStore &store)
+{
+	void* map = mmap(NULL, store.size, PROT_READ | PROT_WRITE, MAP_SHARED, store.fd, 0);
+	if (map == MAP_FAILED) {
+		close(store.fd);
+		store.map = NULL;
+		return 0;
+	}
+	store.map = (unsigned char*)map;
+	// chunks are visited in the player's neighbourhood, not front to back
+	madvise(store.map, store.size, MADV_RANDOM);
+	return 1;
+}
+
+int chunkStoreCreate (struct ChunkStore &store, const char* path, int width, int depth)
+{
+	store.map = NULL;
+	store.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (store.fd < 0)
+		return 0;
+	setSize(store, width, depth);
+
+	// a sparse file: untouched chunks read as zero (floor) and take no disk space
+	if (ftruncate(store.fd, store.size) != 0) {
+		close(store.fd);
+		return 0;
+	}
+	if (!mapFile(store))
+		return 0;
+
+	struct ChunkHeader header;
+	memcpy(header.magic, World_magic, sizeof(header.magic));
+	header.width = width;
+	header.depth = depth;
+	header.chunkSize = CHUNK_SIZE;
+	memcpy(store.map, &header, sizeof(header));
+	return 1;
+}
+
+int chunkStoreOpen (struct ChunkStore &store, const char* path)
+{
+	store.map = NULL;
+	store.fd = open(path, O_RDWR);
+	if (store.fd < 0)
+		return 0;
+
+	struct ChunkHeader header;
+	struct stat st;
+	if (read(store.fd, &header, sizeof(header)) != sizeof(header) || memcmp(header.magic, World_magic, sizeof(header.magic)) != 0
+		|| header.chunkSize != CHUNK_SIZE || header.width < 1 || header.depth < 1 || fstat(store.fd, &st) != 0) {
+		close(store.fd);
+		return 0;
+	}
+	setSize(store, header.width, header.depth);
+	if ((size_t)st.st_size < store.size) {
+		close(store.fd);
+		return 0;
+	}
+	return mapFile(store);
+}
+
+void chunkStoreClose (struct ChunkStore &store)
+{
+	if (store.map == NULL)
+		return;
+	munmap(store.map, store.size);
+	close(store.fd);
+	store.map = NULL;
+}
+
+/* madvise wants page aligned addresses; a chunk is one page on 4 KB systems
+   and shares a page with its neighbours on larger ones */
+static void adviseChunk (const struct ChunkStore &store, int ci, int cj, int advice)
+{
+	uintptr_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t begin = (uintptr_t)chunkData(store, ci, cj);
+	uintptr_t end = begin + CHUNK_BYTES;
+	begin &= ~(page - 1);
+	madvise((void*)begin, end - begin, advice);
+}
+
+void chunkStorePrefetch (const struct ChunkStore &store, int ci, int cj)
+{
+	adviseChunk(store, ci, cj, MADV_WILLNEED);
+}
+
+void chunkStoreRelease (const struct ChunkStore &store, int ci, int cj)
+{
+	adviseChunk(store, ci, cj, MADV_DONTNEED);
+}
@@ -0,0 +1,50 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <stddef.h>
+
+/* World terrain kept in a memory-mapped file instead of the heap. After a
+   one page header the grid is stored as square chunks of CHUNK_SIZE x
+   CHUNK_SIZE cells, one byte per cell, chunk after chunk. A chunk is one
+   4 KB page, so it can be read ahead or dropped on its own and only the
+   chunks near the player need to be resident. */
+
+#define CHUNK_SIZE 64
+#define CHUNK_BYTES (CHUNK_SIZE*CHUNK_SIZE)
+#define CHUNK_HEADER_BYTES 4096
+
+#define CELL_HOLE 1 // the player falls through this cell
+
+struct ChunkStore {
+	int width, depth;     // cells
+	int chunksX, chunksZ; // chunks along i and along j, edge chunks are partly unused
+	unsigned char* map;   // the whole file, NULL when nothing is mapped
+	size_t size;
+	int fd;
+};
+
+/* Create (or overwrite) path as a width x depth world with no holes, and map it */
+int chunkStoreCreate (struct ChunkStore &store, const char* path, int width, int depth);
+
+/* Map an existing world file; 0 if it is missing or not a world file */
+int chunkStoreOpen (struct ChunkStore &store, const char* path);
+
+void chunkStoreClose (struct ChunkStore &store);
+
+/* The CHUNK_BYTES cells of chunk (ci, cj), row by row along i */
+inline unsigned char* chunkData (const struct ChunkStore &store, int ci, int cj)
+{
+	return store.map + CHUNK_HEADER_BYTES + ((size_t)ci*store.chunksZ + cj)*CHUNK_BYTES;
+}
+
+inline unsigned char* chunkStoreCell (const struct ChunkStore &store, int i, int j)
+{
+	return chunkData(store, i / CHUNK_SIZE, j / CHUNK_SIZE) + (i % CHUNK_SIZE)*CHUNK_SIZE + j % CHUNK_SIZE;
+}
+
+/* Ask the kernel to read a chunk ahead / to drop it from this process.
+   Both are hints: a dropped chunk is read back from the file on next use. */
+void chunkStorePrefetch (const struct ChunkStore &store, int ci, int cj);
+void chunkStoreRelease (const struct ChunkStore &store, int ci, int cj);
+
+#endif
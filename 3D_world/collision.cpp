@@ -0,0 +1,108 @@
+#include "collision.h"
+
+#include <cmath>
+#include <algorithm>
+
+#define SWEEP_SKIN 1e-4f // gap left between the box and the face it stopped at
+#define SWEEP_SLIDES 3 // first hit, slide along one axis, then the other
+
+struct CellRange cellRange (float minx, float maxx, float minz, float maxz, int width, int depth)
+{
+	// cell i touches [minx,maxx] when i <= maxx and i+1 >= minx; depth runs along -z
+	struct CellRange range;
+	range.i0 = (int)ceil(minx) - 1;
+	range.i1 = (int)floor(maxx);
+	range.j0 = (int)ceil(-maxz) - 1;
+	range.j1 = (int)floor(-minz);
+	if (range.i0 < 0) range.i0 = 0;
+	if (range.j0 < 0) range.j0 = 0;
+	if (range.i1 > width-1) range.i1 = width-1;
+	if (range.j1 > depth-1) range.j1 = depth-1;
+	return range;
+}
+
+int collisionFind (const struct BitGrid &layer, const struct CellRange &range, int* hiti, int* hitj)
+{
+	return bitGridFind(layer, range.i0, range.i1, range.j0, range.j1, hiti, hitj);
+}
+
+int collisionFindScan (const struct BitGrid &layer, float minx, float maxx, float minz, float maxz, int* hiti, int* hitj)
+{
+	for (int i=0; i<layer.width; i++)
+		for (int j=0; j<layer.depth; j++)
+			if (bitGet(layer, i, j) && maxx >= i && minx <= i+1 && -minz >= j && -maxz <= j+1) {
+				*hiti = i;
+				*hitj = j;
+				return 1;
+			}
+	return 0;
+}
+
+/* Entry and exit times of p + t*d through the slab [lo,hi]; a ray parallel to the
+   slab is inside only strictly between the faces, so grazing a face is not a hit */
+static int slab (float p, float d, float lo, float hi, float* enter, float* exit)
+{
+	if (d == 0) {
+		*enter = -INFINITY;
+		*exit = INFINITY;
+		return p > lo && p < hi;
+	}
+	float t0 = (lo - p) / d, t1 = (hi - p) / d;
+	*enter = std::min(t0, t1);
+	*exit = std::max(t0, t1);
+	return 1;
+}
+
+void collisionSweep (const struct BitGrid &solid, float hx, float hz, float* x, float* z, float dx, float dz)
+{
+	for (int slide=0; slide<SWEEP_SLIDES && (dx != 0 || dz != 0); slide++) {
+		// only cells under the swept bounds can be hit
+		float minx = std::min(*x, *x + dx) - hx, maxx = std::max(*x, *x + dx) + hx;
+		float minz = std::min(*z, *z + dz) - hz, maxz = std::max(*z, *z + dz) + hz;
+		struct CellRange range = cellRange(minx, maxx, minz, maxz, solid.width, solid.depth);
+
+		float hit = 1;
+		int normal = -1; // 0 = stopped on an x face, 1 = on a z face
+		for (int i=range.i0; i<=range.i1; i++)
+			for (int w=range.j0 >> 6; w<=(range.j1 >> 6) && range.j0 <= range.j1; w++) {
+				uint64_t word = solid.bits[i*solid.words + w];
+				while (word) {
+					int j = 64*w + __builtin_ctzll(word);
+					word &= word - 1;
+					if (j < range.j0 || j > range.j1)
+						continue;
+
+					// cell (i,j) grown by the half size, tested as a ray from the centre
+					float ex0, ex1, ez0, ez1;
+					if (!slab(*x, dx, i - hx, i + 1 + hx, &ex0, &ex1) ||
+						!slab(*z, dz, -(j + 1) - hz, -j + hz, &ez0, &ez1))
+						continue;
+					float enter = std::max(ex0, ez0), exit = std::min(ex1, ez1);
+					if (enter > exit || exit <= 0 || enter < 0 || enter >= hit)
+						continue;
+					hit = enter;
+					normal = (ex0 > ez0) ? 0 : 1;
+				}
+			}
+
+		if (normal < 0) {
+			*x += dx;
+			*z += dz;
+			return;
+		}
+
+		// stop just short of the face, then keep only the motion along it
+		*x += dx*hit;
+		*z += dz*hit;
+		if (normal == 0) {
+			*x -= (dx > 0) ? SWEEP_SKIN : -SWEEP_SKIN;
+			dx = 0;
+			dz *= 1 - hit;
+		}
+		else {
+			*z -= (dz > 0) ? SWEEP_SKIN : -SWEEP_SKIN;
+			dz = 0;
+			dx *= 1 - hit;
+		}
+	}
+}
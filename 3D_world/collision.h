@@ -0,0 +1,27 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "occupancy.h"
+
+/* Grid cell (i,j) covers x in [i,i+1] and -z in [j,j+1]. Bounds are inclusive,
+   so a box sitting exactly on a cell edge touches both neighbours. */
+struct CellRange {
+	int i0, i1, j0, j1; // inclusive, empty when i0 > i1 or j0 > j1
+};
+
+/* Cells covered by the box [minx,maxx] x [minz,maxz], clamped to a width x depth grid */
+struct CellRange cellRange (float minx, float maxx, float minz, float maxz, int width, int depth);
+
+/* First set cell of the layer inside the range in (i,j) order, or 0 if none */
+int collisionFind (const struct BitGrid &layer, const struct CellRange &range, int* hiti, int* hitj);
+
+/* Same answer by scanning the whole grid, kept for reference and benchmarking */
+int collisionFindScan (const struct BitGrid &layer, float minx, float maxx, float minz, float maxz, int* hiti, int* hitj);
+
+/* Move a box of half size (hx,hz) centred on (*x,*z) by (dx,dz) against the set cells of
+   a layer. The box stops at the first face it would cross and slides along it for the
+   rest of the move, so any step length is safe. Cells it already overlaps are ignored,
+   which lets it walk out of a block that appeared underneath it. */
+void collisionSweep (const struct BitGrid &solid, float hx, float hz, float* x, float* z, float dx, float dz);
+
+#endif
@@ -0,0 +1,151 @@
+/* Compares cell-indexed collision queries against the old full-grid scan,
+   then checks collisionSweep on random moves. Exits with status 1 if either
+   disagrees. Build with "make collision_bench" and run ./collision_bench */
+
+#include "collision.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+static double seconds ()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#define SKIN 1e-4f // collision.cpp's SWEEP_SKIN
+
+static void randomLayer (struct BitGrid &layer, int size)
+{
+	// same fill rate as the game: a handful of flagged cells per 10x10
+	bitGridInit(layer, size, size);
+	for (int i=0; i<size; i++)
+		for (int j=0; j<size; j++)
+			bitSet(layer, i, j, rand()%20 == 0);
+}
+
+static int solidAt (const struct BitGrid &layer, float x, float z)
+{
+	int i = floor(x), j = floor(-z);
+	return i >= 0 && i < layer.width && j >= 0 && j < layer.depth && bitGet(layer, i, j);
+}
+
+/* Where an axis-aligned move of a point from (x,z) has to stop: just short of
+   the first solid cell whose face it crosses, found by walking cell by cell */
+static void expectedStop (const struct BitGrid &layer, float x, float z, float dx, float dz, float* ex, float* ez)
+{
+	int i = floor(x), j = floor(-z);
+	*ex = x + dx;
+	*ez = z + dz;
+	if (dx > 0) {
+		for (int c=i+1; c < x+dx && c < layer.width; c++)
+			if (bitGet(layer, c, j)) { *ex = c - SKIN; return; }
+	}
+	else if (dx < 0) {
+		for (int c=i-1; c+1 > x+dx && c >= 0; c--)
+			if (bitGet(layer, c, j)) { *ex = c+1 + SKIN; return; }
+	}
+	else if (dz > 0) {
+		for (int c=j-1; -(c+1) < z+dz && c >= 0; c--)
+			if (bitGet(layer, i, c)) { *ez = -(c+1) - SKIN; return; }
+	}
+	else if (dz < 0) {
+		for (int c=j+1; -c > z+dz && c < layer.depth; c++)
+			if (bitGet(layer, i, c)) { *ez = -c + SKIN; return; }
+	}
+}
+
+/* Random starts outside the solid cells and steps up to the grid size: axis
+   moves must stop at the first face in their path, and no move, straight or
+   diagonal with slides, may end inside a solid cell */
+static int checkSweep (int size, int moves)
+{
+	struct BitGrid layer;
+	randomLayer(layer, size);
+
+	int wrong_stop = 0, inside = 0;
+	for (int m=0; m<moves; m++) {
+		float x, z;
+		do {
+			x = size * (rand() / (float)RAND_MAX);
+			z = -size * (rand() / (float)RAND_MAX);
+		} while (solidAt(layer, x, z) || x == floor(x) || z == floor(z)); // a path along a face line only grazes it
+
+		float length = size * (rand() / (float)RAND_MAX);
+		float dx = 0, dz = 0;
+		int axis = m%2 == 0;
+		if (axis) {
+			int dir = rand()%4;
+			dx = dir == 0 ? length : dir == 1 ? -length : 0;
+			dz = dir == 2 ? length : dir == 3 ? -length : 0;
+		}
+		else {
+			dx = length * (2*(rand() / (float)RAND_MAX) - 1);
+			dz = length * (2*(rand() / (float)RAND_MAX) - 1);
+		}
+
+		float ex, ez, sx = x, sz = z;
+		expectedStop(layer, x, z, dx, dz, &ex, &ez);
+		collisionSweep(layer, 0, 0, &sx, &sz, dx, dz);
+		if (axis && (fabs(sx - ex) > 1e-3f || fabs(sz - ez) > 1e-3f))
+			wrong_stop++;
+		inside += solidAt(layer, sx, sz);
+	}
+	printf("%5dx%-5d  sweep: %d random moves, %d axis moves stopped at the wrong place, %d ended inside a solid cell\n",
+		size, size, moves, wrong_stop, inside);
+	return wrong_stop + inside;
+}
+
+static int bench (int size, int queries)
+{
+	struct BitGrid layer;
+	randomLayer(layer, size);
+
+	vector<float> px(queries), pz(queries);
+	for (int q=0; q<queries; q++) {
+		px[q] = size * (rand() / (float)RAND_MAX);
+		pz[q] = -size * (rand() / (float)RAND_MAX);
+	}
+
+	int hits = 0, mismatches = 0;
+	double start = seconds();
+	for (int q=0; q<queries; q++) {
+		int i, j;
+		hits += collisionFind(layer, cellRange(px[q], px[q], pz[q], pz[q], size, size), &i, &j);
+	}
+	double indexed = seconds() - start;
+
+	// the scan is far slower on big grids, so run only as many queries as fit in about a second
+	int scanned = 0;
+	start = seconds();
+	while (scanned < queries && seconds() - start < 1.0) {
+		int i, j, si, sj;
+		int a = collisionFind(layer, cellRange(px[scanned], px[scanned], pz[scanned], pz[scanned], size, size), &i, &j);
+		int b = collisionFindScan(layer, px[scanned], px[scanned], pz[scanned], pz[scanned], &si, &sj);
+		if (a != b || (a && (i != si || j != sj)))
+			mismatches++;
+		scanned++;
+	}
+	double scan = seconds() - start;
+
+	printf("%5dx%-5d  indexed %9.1f ns/query  scan %12.1f ns/query  (%d/%d hits, %d scan queries, %d mismatches)\n",
+		size, size, 1e9*indexed/queries, 1e9*scan/scanned, hits, queries, scanned, mismatches);
+	return mismatches;
+}
+
+int main ()
+{
+	srand(1);
+	int sizes[] = { 10, 256, 4096 };
+	int failures = 0;
+	for (int k=0; k<3; k++)
+		failures += bench(sizes[k], 1000000);
+	// float spacing near 4096 is too coarse for the 1e-4 skin, so the sweep is checked on the smaller grids
+	failures += checkSweep(10, 200000);
+	failures += checkSweep(256, 200000);
+	return failures > 0;
+}
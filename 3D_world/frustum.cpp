@@ -0,0 +1,167 @@
+#include "frustum.h"
+
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CULL_X86
+#include <immintrin.h>
+#endif
+
+void frustumFromMatrix (const float* m, struct Frustum &frustum)
+{
+	// row r of the matrix is (m[r], m[4+r], m[8+r], m[12+r])
+	for (int k=0; k<6; k++) {
+		int r = k/2;
+		float sign = (k%2 == 0) ? 1.0f : -1.0f; // left/bottom/near add, right/top/far subtract
+		float* p = frustum.planes[k];
+		for (int c=0; c<4; c++)
+			p[c] = m[4*c + 3] + sign*m[4*c + r];
+
+		float len = sqrt(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+		if (len > 0)
+			for (int c=0; c<4; c++)
+				p[c] /= len;
+	}
+}
+
+void cullListClear (struct CullList &list)
+{
+	list.minx.clear(); list.miny.clear(); list.minz.clear();
+	list.maxx.clear(); list.maxy.clear(); list.maxz.clear();
+	list.visible.clear();
+}
+
+void cullListAdd (struct CullList &list, float minx, float miny, float minz, float maxx, float maxy, float maxz)
+{
+	list.minx.push_back(minx); list.miny.push_back(miny); list.minz.push_back(minz);
+	list.maxx.push_back(maxx); list.maxy.push_back(maxy); list.maxz.push_back(maxz);
+}
+
+/* The box corner furthest along the plane normal decides: if even that one is
+   behind the plane the whole box is. Its distance is d + sum of
+   max(n*min, n*max) per axis, which needs no branches. */
+static bool boxVisible (const struct Frustum &frustum, float minx, float miny, float minz, float maxx, float maxy, float maxz)
+{
+	for (int k=0; k<6; k++) {
+		const float* p = frustum.planes[k];
+		float d = p[3] + fmax(p[0]*minx, p[0]*maxx) + fmax(p[1]*miny, p[1]*maxy) + fmax(p[2]*minz, p[2]*maxz);
+		if (d < 0)
+			return false;
+	}
+	return true;
+}
+
+/* Boxes begin..n-1 one at a time, also the tail the vector loops leave over */
+static int runScalar (struct CullList &list, const struct Frustum &frustum, int begin)
+{
+	int n = list.minx.size();
+	int visible = 0;
+	for (int i=begin; i<n; i++) {
+		list.visible[i] = boxVisible(frustum, list.minx[i], list.miny[i], list.minz[i], list.maxx[i], list.maxy[i], list.maxz[i]);
+		visible += list.visible[i];
+	}
+	return visible;
+}
+
+#ifdef CULL_X86
+
+__attribute__((target("avx")))
+static int runAvx (struct CullList &list, const struct Frustum &frustum)
+{
+	int n = list.minx.size();
+	int visible = 0;
+	int i = 0;
+	for (; i+8 <= n; i+=8) {
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k=0; k<6; k++) {
+			const float* p = frustum.planes[k];
+			__m256 a = _mm256_set1_ps(p[0]), b = _mm256_set1_ps(p[1]), c = _mm256_set1_ps(p[2]);
+			__m256 d = _mm256_set1_ps(p[3]);
+			d = _mm256_add_ps(d, _mm256_max_ps(_mm256_mul_ps(a, _mm256_loadu_ps(&list.minx[i])), _mm256_mul_ps(a, _mm256_loadu_ps(&list.maxx[i]))));
+			d = _mm256_add_ps(d, _mm256_max_ps(_mm256_mul_ps(b, _mm256_loadu_ps(&list.miny[i])), _mm256_mul_ps(b, _mm256_loadu_ps(&list.maxy[i]))));
+			d = _mm256_add_ps(d, _mm256_max_ps(_mm256_mul_ps(c, _mm256_loadu_ps(&list.minz[i])), _mm256_mul_ps(c, _mm256_loadu_ps(&list.maxz[i]))));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		int mask = _mm256_movemask_ps(inside);
+		for (int l=0; l<8; l++) {
+			list.visible[i+l] = (mask >> l) & 1;
+			visible += (mask >> l) & 1;
+		}
+	}
+	return visible + runScalar(list, frustum, i);
+}
+
+__attribute__((target("sse")))
+static int runSse (struct CullList &list, const struct Frustum &frustum)
+{
+	int n = list.minx.size();
+	int visible = 0;
+	int i = 0;
+	for (; i+4 <= n; i+=4) {
+		__m128 inside = _mm_cmpeq_ps(_mm_setzero_ps(), _mm_setzero_ps()); // all ones
+		for (int k=0; k<6; k++) {
+			const float* p = frustum.planes[k];
+			__m128 a = _mm_set1_ps(p[0]), b = _mm_set1_ps(p[1]), c = _mm_set1_ps(p[2]);
+			__m128 d = _mm_set1_ps(p[3]);
+			d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(a, _mm_loadu_ps(&list.minx[i])), _mm_mul_ps(a, _mm_loadu_ps(&list.maxx[i]))));
+			d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(b, _mm_loadu_ps(&list.miny[i])), _mm_mul_ps(b, _mm_loadu_ps(&list.maxy[i]))));
+			d = _mm_add_ps(d, _mm_max_ps(_mm_mul_ps(c, _mm_loadu_ps(&list.minz[i])), _mm_mul_ps(c, _mm_loadu_ps(&list.maxz[i]))));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (int l=0; l<4; l++) {
+			list.visible[i+l] = (mask >> l) & 1;
+			visible += (mask >> l) & 1;
+		}
+	}
+	return visible + runScalar(list, frustum, i);
+}
+
+#endif
+
+int cullPath ()
+{
+	static int path = -1;
+	if (path < 0) {
+		path = CULL_SCALAR;
+#ifdef CULL_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx"))
+			path = CULL_AVX;
+		else if (__builtin_cpu_supports("sse"))
+			path = CULL_SSE;
+#endif
+	}
+	return path;
+}
+
+const char* cullPathName (int path)
+{
+	switch (path) {
+		case CULL_AVX: return "avx";
+		case CULL_SSE: return "sse";
+		default: return "scalar";
+	}
+}
+
+int cullListRunPath (int path, struct CullList &list, const struct Frustum &frustum)
+{
+	list.visible.resize(list.minx.size());
+#ifdef CULL_X86
+	if (path == CULL_AVX)
+		return runAvx(list, frustum);
+	if (path == CULL_SSE)
+		return runSse(list, frustum);
+#endif
+	return runScalar(list, frustum, 0);
+}
+
+int cullListRunScalar (struct CullList &list, const struct Frustum &frustum)
+{
+	return cullListRunPath(CULL_SCALAR, list, frustum);
+}
+
+int cullListRun (struct CullList &list, const struct Frustum &frustum)
+{
+	return cullListRunPath(cullPath(), list, frustum);
+}
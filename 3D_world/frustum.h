@@ -0,0 +1,41 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <vector>
+
+/* Six planes (a,b,c,d), inside where a*x + b*y + c*z + d >= 0 */
+struct Frustum {
+	float planes[6][4];
+};
+
+/* Extract the planes of a column-major projection*view matrix (e.g. &VP[0][0]) */
+void frustumFromMatrix (const float* m, struct Frustum &frustum);
+
+/* Axis aligned boxes in structure-of-arrays form, so the test can run 4 or 8 at a time */
+struct CullList {
+	std::vector<float> minx, miny, minz;
+	std::vector<float> maxx, maxy, maxz;
+	std::vector<unsigned char> visible; // filled by cullListRun, 1 = at least partly inside
+};
+
+void cullListClear (struct CullList &list);
+void cullListAdd (struct CullList &list, float minx, float miny, float minz, float maxx, float maxy, float maxz);
+
+#define CULL_SCALAR 0
+#define CULL_SSE 1
+#define CULL_AVX 2
+
+/* Best path this CPU supports, checked once at runtime */
+int cullPath ();
+const char* cullPathName (int path);
+
+/* Test every box in the list with the best path, return how many are visible */
+int cullListRun (struct CullList &list, const struct Frustum &frustum);
+
+/* One specific path, for testing and benchmarking; the path must be supported */
+int cullListRunPath (int path, struct CullList &list, const struct Frustum &frustum);
+
+/* Reference version of the same test, one box at a time */
+int cullListRunScalar (struct CullList &list, const struct Frustum &frustum);
+
+#endif
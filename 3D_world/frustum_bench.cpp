@@ -0,0 +1,75 @@
+/* Times frustum culling of grid cell boxes on each path the CPU supports and
+   checks they agree with the scalar test; exits with status 1 if any path
+   disagrees. Build with "make frustum_bench" and run ./frustum_bench */
+
+#include "frustum.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+static double seconds ()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int bench (int side, int runs)
+{
+	// unit cells of a side x side grid with random heights; the planes cut
+	// through the grid (one of them diagonally) and its heights, so a sixth is inside
+	struct CullList list;
+	cullListClear(list);
+	for (int i=0; i<side; i++)
+		for (int j=0; j<side; j++)
+			cullListAdd(list, i-0.5f, -9.0f, -j-0.5f, i+0.5f, 2.0f * (rand() / (float)RAND_MAX), -j+0.5f);
+	const float s = 0.70710678f;
+	const float planes[6][4] = {
+		{1, 0, 0, -1},             // x >= 1
+		{-1, 0, 0, 0.8f*side},     // x <= 0.8 side
+		{0, 0, -1, -1},            // z <= -1
+		{0, 0, 1, 0.8f*side},      // z >= -0.8 side
+		{s, 0, s, 0},              // x >= -z: the cells with i >= j
+		{0, 1, 0, -1},             // y >= 1: drops the shorter half of the boxes
+	};
+	struct Frustum frustum;
+	for (int k=0; k<6; k++)
+		for (int c=0; c<4; c++)
+			frustum.planes[k][c] = planes[k][c];
+
+	vector<unsigned char> reference;
+	int total_mismatches = 0;
+	for (int path=CULL_SCALAR; path<=cullPath(); path++) {
+		int visible = 0;
+		double start = seconds();
+		for (int r=0; r<runs; r++)
+			visible = cullListRunPath(path, list, frustum);
+		double elapsed = seconds() - start;
+
+		int mismatches = 0;
+		if (path == CULL_SCALAR)
+			reference = list.visible;
+		else
+			for (size_t k=0; k<reference.size(); k++)
+				mismatches += reference[k] != list.visible[k];
+		printf("%8d boxes  %-6s %8.3f ms/run  %6.3f ns/box  (%d visible)", side*side, cullPathName(path),
+			1e3*elapsed/runs, 1e9*elapsed/runs/(side*side), visible);
+		if (mismatches > 0)
+			printf("  MISMATCH in %d boxes", mismatches);
+		printf("\n");
+		total_mismatches += mismatches;
+	}
+	return total_mismatches;
+}
+
+int main ()
+{
+	srand(1);
+	int mismatches = 0;
+	mismatches += bench(10, 100000);
+	mismatches += bench(257, 200); // odd count, so the vector loops leave a tail
+	mismatches += bench(1000, 20);
+	return mismatches > 0;
+}
@@ -0,0 +1,96 @@
+#include "gl_state.h"
+
+struct GLStateCounters GL_state_frame = {0, 0};
+struct GLStateCounters GL_state_current = {0, 0};
+
+/* ~0 never matches a real GL name, so the first call after a reset always goes through */
+static const GLuint UNKNOWN = ~0u;
+
+static GLuint cur_program = UNKNOWN;
+static GLuint cur_vao = UNKNOWN;
+static GLuint cur_polygon_mode = UNKNOWN;
+static GLuint cur_array_buffer = UNKNOWN;
+static GLuint cur_element_buffer = UNKNOWN;
+static GLuint cur_uniform_buffer = UNKNOWN;
+
+void stateReset ()
+{
+	cur_program = UNKNOWN;
+	cur_vao = UNKNOWN;
+	cur_polygon_mode = UNKNOWN;
+	cur_array_buffer = UNKNOWN;
+	cur_element_buffer = UNKNOWN;
+	cur_uniform_buffer = UNKNOWN;
+}
+
+void stateFrameBegin ()
+{
+	GL_state_frame = GL_state_current;
+	GL_state_current.issued = 0;
+	GL_state_current.skipped = 0;
+}
+
+/* Update the shadow value, return true when GL has to be told */
+static bool changed (GLuint &shadow, GLuint value)
+{
+	if (shadow == value) {
+		GL_state_current.skipped++;
+		return false;
+	}
+	shadow = value;
+	GL_state_current.issued++;
+	return true;
+}
+
+void stateUseProgram (GLuint program)
+{
+	if (changed(cur_program, program))
+		glUseProgram(program);
+}
+
+void stateBindVertexArray (GLuint vao)
+{
+	if (changed(cur_vao, vao)) {
+		glBindVertexArray(vao);
+		// the element buffer binding belongs to the VAO
+		cur_element_buffer = UNKNOWN;
+	}
+}
+
+void statePolygonMode (GLenum mode)
+{
+	if (changed(cur_polygon_mode, mode))
+		glPolygonMode(GL_FRONT_AND_BACK, mode);
+}
+
+void stateBindBuffer (GLenum target, GLuint buffer)
+{
+	GLuint *shadow;
+	switch (target) {
+		case GL_ARRAY_BUFFER:
+			shadow = &cur_array_buffer;
+			break;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			shadow = &cur_element_buffer;
+			break;
+		case GL_UNIFORM_BUFFER:
+			shadow = &cur_uniform_buffer;
+			break;
+		default:
+			// untracked target, always pass through
+			GL_state_current.issued++;
+			glBindBuffer(target, buffer);
+			return;
+	}
+	if (changed(*shadow, buffer))
+		glBindBuffer(target, buffer);
+}
+
+void stateBindBufferRange (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	// ranges move every frame, so there is nothing to skip here
+	GL_state_current.issued++;
+	glBindBufferRange(target, index, buffer, offset, size);
+	if (target == GL_UNIFORM_BUFFER)
+		cur_uniform_buffer = buffer;
+}
@@ -0,0 +1,32 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+/* Shadow copy of the GL state the renderer touches. Every state* call
+   compares against the shadow first and only reaches the driver when the
+   value actually changes. */
+
+struct GLStateCounters {
+	int issued;  // calls passed on to GL
+	int skipped; // calls dropped because the state was already current
+};
+
+extern struct GLStateCounters GL_state_frame; // totals of the last finished frame
+extern struct GLStateCounters GL_state_current; // running totals of this frame
+
+/* Forget all shadow values, e.g. after GL calls made behind the tracker's back */
+void stateReset ();
+
+/* Close the current frame's counters and start new ones */
+void stateFrameBegin ();
+
+void stateUseProgram (GLuint program);
+void stateBindVertexArray (GLuint vao);
+void statePolygonMode (GLenum mode);
+void stateBindBuffer (GLenum target, GLuint buffer);
+
+/* glBindBufferRange also rebinds the generic target, keep the shadow in step */
+void stateBindBufferRange (GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+#endif
@@ -0,0 +1,68 @@
+#include "gpu_timer.h"
+#include "profiler.h"
+
+void gpuTimerInit (struct GpuTimer &timer)
+{
+	for (int f=0; f<GPU_TIMER_FRAMES; f++) {
+		glGenQueries(GPU_TIMER_SECTIONS, timer.frames[f].queries);
+		timer.frames[f].count = 0;
+	}
+	timer.frame = 0;
+	timer.open = 0;
+	timer.track = profileNamedTrack("GPU");
+	timer.dropped = 0;
+}
+
+void gpuTimerBegin (struct GpuTimer &timer, const char* name)
+{
+	profileBegin(name);
+	struct GpuTimerFrame &frame = timer.frames[timer.frame];
+	if (!Profiling || timer.open || frame.count == GPU_TIMER_SECTIONS)
+		return;
+	frame.names[frame.count] = name;
+	frame.starts[frame.count] = profileNow();
+	glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.count]);
+	timer.open = 1;
+}
+
+void gpuTimerEnd (struct GpuTimer &timer)
+{
+	if (timer.open) {
+		glEndQuery(GL_TIME_ELAPSED);
+		timer.frames[timer.frame].count++;
+		timer.open = 0;
+	}
+	profileEnd();
+}
+
+void gpuTimerFrameEnd (struct GpuTimer &timer)
+{
+	timer.frame = (timer.frame + 1) % GPU_TIMER_FRAMES;
+
+	// the frame we are about to reuse was issued GPU_TIMER_FRAMES-1 frames ago
+	struct GpuTimerFrame &frame = timer.frames[timer.frame];
+	for (int k=0; k<frame.count; k++) {
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[k], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			timer.dropped++;
+			continue;
+		}
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(frame.queries[k], GL_QUERY_RESULT, &nanoseconds);
+
+		struct ProfileEvent event;
+		event.name = frame.names[k];
+		event.track = timer.track;
+		event.start = frame.starts[k];
+		event.end = frame.starts[k] + 1e-9*nanoseconds;
+		profilePush(event);
+	}
+	frame.count = 0;
+}
+
+void gpuTimerFree (struct GpuTimer &timer)
+{
+	for (int f=0; f<GPU_TIMER_FRAMES; f++)
+		glDeleteQueries(GPU_TIMER_SECTIONS, timer.frames[f].queries);
+}
@@ -0,0 +1,42 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include <glad/glad.h>
+
+/* GL_TIME_ELAPSED queries around sections of a frame, reported to the
+   profiler on a "GPU" track. Results are picked up GPU_TIMER_FRAMES frames
+   later and only once GL says they are available, so reading them never
+   waits on the GPU; a late result is dropped. Elapsed queries can't nest:
+   a section opened inside another one is timed on the CPU only.
+   Main thread, with the GL context current. */
+
+#define GPU_TIMER_FRAMES 4    // frames in flight before a query is reused
+#define GPU_TIMER_SECTIONS 16 // per frame
+
+struct GpuTimerFrame {
+	GLuint queries[GPU_TIMER_SECTIONS];
+	const char* names[GPU_TIMER_SECTIONS];
+	double starts[GPU_TIMER_SECTIONS]; // CPU time at glBeginQuery, where the section is placed in the trace
+	int count;
+};
+
+struct GpuTimer {
+	struct GpuTimerFrame frames[GPU_TIMER_FRAMES];
+	int frame; // frames[frame] collects this frame's sections
+	int open;  // a query is running
+	int track;
+	int dropped; // results that weren't ready in time
+};
+
+void gpuTimerInit (struct GpuTimer &timer);
+
+/* CPU scope plus, unless one is already running, a GPU query */
+void gpuTimerBegin (struct GpuTimer &timer, const char* name);
+void gpuTimerEnd (struct GpuTimer &timer);
+
+/* Read back the oldest frame's finished queries and start a new frame */
+void gpuTimerFrameEnd (struct GpuTimer &timer);
+
+void gpuTimerFree (struct GpuTimer &timer);
+
+#endif
@@ -0,0 +1,180 @@
+#include "hud.h"
+#include "gl_state.h"
+#include "profiler.h" // profileNow
+
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+#define HUD_PIXEL 2 // screen pixels per font pixel
+#define HUD_ADVANCE (4*HUD_PIXEL)
+#define HUD_LINE (7*HUD_PIXEL)
+#define HUD_MARGIN 8
+#define HUD_GRAPH_HEIGHT 60
+#define HUD_GRAPH_SECONDS (2.0/60) // top of the graph, two 60 Hz frames
+
+/* 3x5 glyphs, one octal digit per row from the top, the high bit of a row is its left column */
+static const char Font_chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ.:/%-";
+static const unsigned short Font_glyphs[] = {
+	075557, 026227, 071747, 071717, 055711, 074717, 074757, 071111, 075757, 075717,
+	025755, 065656, 034443, 065556, 074647, 074644, 034553, 055755, 072227, 011152,
+	055655, 044447, 057755, 065555, 025552, 065644, 025563, 065655, 034216, 072222,
+	055557, 055552, 055775, 055255, 055222, 071247,
+	000002, 002020, 011244, 051245, 000700,
+};
+
+static const GLubyte White[4] = {255, 255, 255, 255};
+static const GLubyte Panel[4] = {24, 24, 32, 255};
+static const GLubyte Grid[4] = {110, 110, 120, 255};
+static const GLubyte Good[4] = {80, 220, 100, 255};
+static const GLubyte Slow[4] = {240, 190, 60, 255};
+static const GLubyte Bad[4] = {240, 70, 60, 255};
+
+void hudInit (struct Hud &hud)
+{
+	streamBufferInit(hud.stream, 3*HUD_MAX_QUADS*4*sizeof(struct HudVertex));
+
+	// quad q is vertices 4q..4q+3 clockwise from the top left
+	vector<GLushort> indices(6*HUD_MAX_QUADS);
+	for (int q=0; q<HUD_MAX_QUADS; q++) {
+		GLushort v = 4*q, quad[6] = {v, (GLushort)(v+1), (GLushort)(v+2), v, (GLushort)(v+2), (GLushort)(v+3)};
+		memcpy(&indices[6*q], quad, sizeof(quad));
+	}
+	glGenVertexArrays(1, &hud.vao);
+	stateBindVertexArray(hud.vao);
+	glGenBuffers(1, &hud.indices);
+	stateBindBuffer(GL_ELEMENT_ARRAY_BUFFER, hud.indices);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+
+	hud.vertices.reserve(4*HUD_MAX_QUADS);
+	hud.historyCount = hud.historyNext = 0;
+	memset(&hud.last, 0, sizeof(hud.last));
+	hud.buildSeconds = 0;
+}
+
+void hudRecord (struct Hud &hud, const struct HudStats &stats)
+{
+	hud.history[hud.historyNext] = stats.frameSeconds;
+	hud.historyNext = (hud.historyNext + 1) % HUD_HISTORY;
+	hud.historyCount = min(hud.historyCount + 1, HUD_HISTORY);
+	hud.last = stats;
+}
+
+static void addQuad (struct Hud &hud, int x, int y, int w, int h, const GLubyte color[4])
+{
+	if (hud.vertices.size() >= 4*HUD_MAX_QUADS)
+		return;
+	struct HudVertex v;
+	memcpy(v.color, color, 4);
+	v.x = x, v.y = y;
+	hud.vertices.push_back(v);
+	v.x = x+w;
+	hud.vertices.push_back(v);
+	v.y = y+h;
+	hud.vertices.push_back(v);
+	v.x = x;
+	hud.vertices.push_back(v);
+}
+
+/* One quad per horizontal run of lit pixels in each glyph row */
+static void addText (struct Hud &hud, int x, int y, const char* text, const GLubyte color[4])
+{
+	for (; *text; text++, x += HUD_ADVANCE) {
+		const char* found = strchr(Font_chars, toupper(*text));
+		if (*text == ' ' || found == NULL)
+			continue;
+		unsigned glyph = Font_glyphs[found - Font_chars];
+		for (int row=0; row<5; row++) {
+			unsigned bits = (glyph >> 3*(4-row)) & 7;
+			for (int col=0; col<3; col++) {
+				if (!(bits & (4 >> col)))
+					continue;
+				int run = 1;
+				while (col+run < 3 && (bits & (4 >> (col+run))))
+					run++;
+				addQuad(hud, x + col*HUD_PIXEL, y + row*HUD_PIXEL, run*HUD_PIXEL, HUD_PIXEL, color);
+				col += run;
+			}
+		}
+	}
+}
+
+static double percentile (const vector<double> &sorted, int p)
+{
+	return sorted[min(sorted.size()-1, sorted.size()*p/100)];
+}
+
+/* Frame times sorted fastest first, one column per frame, so the x axis is
+   the percentile; lines mark 60 and 30 Hz */
+static void addGraph (struct Hud &hud, int x, int y, int w, const vector<double> &sorted)
+{
+	for (size_t k=0; k<sorted.size(); k++) {
+		double t = sorted[k];
+		int h = max(1, (int)(HUD_GRAPH_HEIGHT * min(1.0, t / HUD_GRAPH_SECONDS)));
+		int column = x + (int)(k * w / sorted.size());
+		int next = x + (int)((k+1) * w / sorted.size());
+		addQuad(hud, column, y + HUD_GRAPH_HEIGHT - h, max(1, next - column), h, t <= 1.0/55 ? Good : t <= 1.0/28 ? Slow : Bad);
+	}
+	addQuad(hud, x, y + HUD_GRAPH_HEIGHT/2, w, 1, Grid);
+	addQuad(hud, x, y, w, 1, Grid);
+}
+
+int hudDraw (struct Hud &hud, GLint mvpLocation, int width, int height)
+{
+	double start = profileNow();
+	hud.vertices.clear();
+
+	static vector<double> sorted;
+	sorted.assign(hud.history, hud.history + hud.historyCount);
+	sort(sorted.begin(), sorted.end());
+
+	char lines[6][64];
+	const struct HudStats &s = hud.last;
+	snprintf(lines[0], sizeof(lines[0]), "FRAME %.2f MS  %.0f FPS", 1000*s.frameSeconds, s.frameSeconds > 0 ? 1/s.frameSeconds : 0.0);
+	if (sorted.empty())
+		lines[1][0] = 0;
+	else
+		snprintf(lines[1], sizeof(lines[1]), "P50 %.1f  P90 %.1f  P99 %.1f  MAX %.1f",
+			1000*percentile(sorted, 50), 1000*percentile(sorted, 90), 1000*percentile(sorted, 99), 1000*sorted.back());
+	snprintf(lines[2], sizeof(lines[2]), "DRAWS %d  STATE %d", s.drawCalls, s.stateChanges);
+	snprintf(lines[3], sizeof(lines[3]), "UPLOAD %.1f KB", s.bytesUploaded/1024.0);
+	snprintf(lines[4], sizeof(lines[4]), "TICKS %d", s.simTicks);
+	snprintf(lines[5], sizeof(lines[5]), "HUD %.3f MS", 1000*hud.buildSeconds);
+
+	int panel_w = 2*HUD_MARGIN + 44*HUD_ADVANCE;
+	int panel_h = 2*HUD_MARGIN + 6*HUD_LINE + HUD_MARGIN + HUD_GRAPH_HEIGHT;
+	addQuad(hud, 0, 0, panel_w, panel_h, Panel);
+	for (int k=0; k<6; k++)
+		addText(hud, HUD_MARGIN, HUD_MARGIN + k*HUD_LINE, lines[k], White);
+	addGraph(hud, HUD_MARGIN, 2*HUD_MARGIN + 6*HUD_LINE, panel_w - 2*HUD_MARGIN, sorted);
+
+	int quads = hud.vertices.size() / 4;
+	streamBufferFrameBegin(hud.stream);
+	size_t offset = streamBufferWrite(hud.stream, &hud.vertices[0], hud.vertices.size()*sizeof(struct HudVertex), sizeof(struct HudVertex));
+
+	// pixels to clip space, y down
+	GLfloat projection[16] = {
+		2.0f/width, 0, 0, 0,
+		0, -2.0f/height, 0, 0,
+		0, 0, 1, 0,
+		-1, 1, 0, 1,
+	};
+	glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, projection);
+
+	statePolygonMode(GL_FILL);
+	stateBindVertexArray(hud.vao);
+	stateBindBuffer(GL_ARRAY_BUFFER, hud.stream.buffer);
+	glVertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, sizeof(struct HudVertex), (void*)offset);
+	glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(struct HudVertex), (void*)(offset + 4));
+	glDrawElements(GL_TRIANGLES, 6*quads, GL_UNSIGNED_SHORT, (void*)0);
+
+	// stop before the fence: a software rasterizer renders the whole frame there
+	hud.buildSeconds = profileNow() - start;
+	streamBufferFrameEnd(hud.stream);
+	return quads;
+}
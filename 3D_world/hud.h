@@ -0,0 +1,56 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <stddef.h>
+#include <vector>
+#include <glad/glad.h>
+#include "stream_buffer.h"
+
+/* Performance overlay: frame time, a percentile graph of recent frames and
+   the renderer's counters. Text (a built-in 3x5 pixel font), the graph and
+   its background are all screen-space quads, rebuilt every frame into one
+   StreamBuffer and drawn with a single glDrawElements, so showing it costs
+   about one draw call and a few KB of upload. Graph lines are thin quads
+   rather than GL_LINES so nothing needs a second primitive type. */
+
+#define HUD_HISTORY 240   // frames in the percentile graph
+#define HUD_MAX_QUADS 4096 // quads past this are dropped
+
+/* What one finished frame cost */
+struct HudStats {
+	double frameSeconds; // the whole frame, overlay and swap included
+	int drawCalls;
+	int stateChanges;    // GL state calls that reached the driver
+	size_t bytesUploaded;
+	int simTicks;        // simulation ticks published since the previous frame
+};
+
+struct HudVertex {
+	GLshort x, y; // pixels from the top left corner
+	GLubyte color[4];
+};
+
+struct Hud {
+	struct StreamBuffer stream; // the overlay's one dynamic vertex buffer
+	GLuint vao;
+	GLuint indices; // static, two triangles per quad
+	std::vector<struct HudVertex> vertices; // this frame's quads, 4 vertices each
+
+	double history[HUD_HISTORY]; // frame seconds, a ring
+	int historyCount, historyNext;
+	struct HudStats last;
+	double buildSeconds; // CPU time hudDraw spent building and uploading last frame
+};
+
+/* Needs the scene program's attribute layout: 0 position, 1 color */
+void hudInit (struct Hud &hud);
+
+/* Add a finished frame */
+void hudRecord (struct Hud &hud, const struct HudStats &stats);
+
+/* Build and draw the overlay for a width x height framebuffer. The caller has
+   the scene program bound with the per-draw MVP path selected; this sets MVP
+   (at mvpLocation) to a pixel projection. Returns the quads drawn. */
+int hudDraw (struct Hud &hud, GLint mvpLocation, int width, int height);
+
+#endif
@@ -0,0 +1,32 @@
+#include "input_queue.h"
+
+void inputQueueInit (struct InputQueue &queue)
+{
+	queue.head.store(0);
+	queue.tail.store(0);
+	queue.dropped = 0;
+}
+
+int inputQueuePush (struct InputQueue &queue, int key, int action)
+{
+	unsigned head = queue.head.load(std::memory_order_relaxed);
+	if (head - queue.tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) {
+		queue.dropped++;
+		return 0;
+	}
+	struct InputEvent &event = queue.events[head & (INPUT_QUEUE_SIZE-1)];
+	event.key = key;
+	event.action = action;
+	queue.head.store(head + 1, std::memory_order_release);
+	return 1;
+}
+
+int inputQueuePop (struct InputQueue &queue, struct InputEvent &event)
+{
+	unsigned tail = queue.tail.load(std::memory_order_relaxed);
+	if (tail == queue.head.load(std::memory_order_acquire))
+		return 0;
+	event = queue.events[tail & (INPUT_QUEUE_SIZE-1)];
+	queue.tail.store(tail + 1, std::memory_order_release);
+	return 1;
+}
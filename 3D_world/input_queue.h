@@ -0,0 +1,31 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include <atomic>
+
+/* Key events passed from the thread that polls the window to the simulation
+   thread: a fixed ring with one producer and one consumer, no locks. */
+
+#define INPUT_QUEUE_SIZE 256 // power of two
+
+struct InputEvent {
+	int key;
+	int action;
+};
+
+struct InputQueue {
+	struct InputEvent events[INPUT_QUEUE_SIZE];
+	std::atomic<unsigned> head; // next slot to write, advanced by the producer
+	std::atomic<unsigned> tail; // next slot to read, advanced by the consumer
+	int dropped; // events lost to a full queue (producer side)
+};
+
+void inputQueueInit (struct InputQueue &queue);
+
+/* Producer: 0 if the queue is full and the event was dropped */
+int inputQueuePush (struct InputQueue &queue, int key, int action);
+
+/* Consumer: 0 if there is nothing to read */
+int inputQueuePop (struct InputQueue &queue, struct InputEvent &event);
+
+#endif
@@ -0,0 +1,133 @@
+#include "input_record.h"
+#include "simulation.h" // gridSizeValid
+
+#include <string.h>
+
+#define RECORD_VERSION 1
+
+static void writeLE (FILE* file, uint64_t value, int bytes)
+{
+	for (int b=0; b<bytes; b++)
+		putc((value >> (8*b)) & 0xFF, file);
+}
+
+static int readLE (FILE* file, uint64_t &value, int bytes)
+{
+	value = 0;
+	for (int b=0; b<bytes; b++) {
+		int c = getc(file);
+		if (c == EOF)
+			return 0;
+		value |= (uint64_t)c << (8*b);
+	}
+	return 1;
+}
+
+/* 7 bits at a time, high bit set while more follow */
+static void writeVarint (FILE* file, uint64_t value)
+{
+	while (value >= 0x80) {
+		putc((value & 0x7F) | 0x80, file);
+		value >>= 7;
+	}
+	putc(value, file);
+}
+
+static int readVarint (FILE* file, uint64_t &value)
+{
+	value = 0;
+	for (int shift=0; shift<64; shift+=7) {
+		int c = getc(file);
+		if (c == EOF)
+			return 0;
+		value |= (uint64_t)(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return 1;
+	}
+	return 0;
+}
+
+int recordOpen (struct InputRecorder &rec, const char* path, uint64_t seed, int width, int depth)
+{
+	rec.file = fopen(path, "wb");
+	if (rec.file == NULL)
+		return 0;
+	fwrite("3DRI", 1, 4, rec.file);
+	writeLE(rec.file, RECORD_VERSION, 4);
+	writeLE(rec.file, seed, 8);
+	writeLE(rec.file, (uint32_t)width, 4);
+	writeLE(rec.file, (uint32_t)depth, 4);
+	rec.lastTick = 0;
+	rec.events = 0;
+	return 1;
+}
+
+void recordEvent (struct InputRecorder &rec, long tick, const struct InputEvent &event)
+{
+	if (rec.file == NULL)
+		return;
+	writeVarint(rec.file, tick - rec.lastTick);
+	putc(event.key*4 + event.action, rec.file);
+	rec.lastTick = tick;
+	rec.events++;
+}
+
+int recordClose (struct InputRecorder &rec, long tick)
+{
+	if (rec.file == NULL)
+		return 1;
+	writeVarint(rec.file, tick - rec.lastTick);
+	putc(RECORD_END, rec.file);
+	int ok = !ferror(rec.file);
+	ok &= fclose(rec.file) == 0;
+	rec.file = NULL;
+	return ok;
+}
+
+int replayLoad (struct InputReplay &replay, const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (file == NULL)
+		return 0;
+
+	char magic[4];
+	uint64_t version, width, depth;
+	replay.events.clear();
+	replay.next = 0;
+	if (fread(magic, 1, 4, file) != 4 || memcmp(magic, "3DRI", 4) != 0 || !readLE(file, version, 4) || version != RECORD_VERSION
+		|| !readLE(file, replay.seed, 8) || !readLE(file, width, 4) || !readLE(file, depth, 4) || !gridSizeValid(width, depth)) {
+		fclose(file);
+		return 0;
+	}
+	replay.width = width;
+	replay.depth = depth;
+
+	long tick = 0;
+	for (;;) {
+		uint64_t delta;
+		int code;
+		if (!readVarint(file, delta) || (code = getc(file)) == EOF) {
+			fclose(file);
+			return 0; // no end marker: the recording was cut short
+		}
+		tick += delta;
+		if (code == RECORD_END)
+			break;
+		struct RecordedEvent r;
+		r.tick = tick;
+		r.event.key = code / 4;
+		r.event.action = code % 4;
+		replay.events.push_back(r);
+	}
+	replay.endTick = tick;
+	fclose(file);
+	return 1;
+}
+
+int replayNext (struct InputReplay &replay, long tick, struct InputEvent &event)
+{
+	if (replay.next >= replay.events.size() || replay.events[replay.next].tick != tick)
+		return 0;
+	event = replay.events[replay.next++].event;
+	return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef INPUT_RECORD_H
+#define INPUT_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include "input_queue.h"
+
+/* Player commands as the simulation applied them, with the tick they were
+   applied before, so a run can be replayed exactly: the world comes from
+   the seed and grid size in the header, everything else from the events.
+   (A --world file is not stored; replay with the same one.)
+
+   File layout, little endian:
+     "3DRI", u32 version, u64 seed, i32 width, i32 depth
+     per event: varint ticks since the previous event, u8 key*4 + action
+     end:       varint ticks since the previous event, u8 0xFF
+   so a typical event takes two bytes. */
+
+#define RECORD_END 0xFF
+
+struct InputRecorder {
+	FILE* file; // NULL when not recording
+	long lastTick;
+	int events;
+};
+
+int recordOpen (struct InputRecorder &rec, const char* path, uint64_t seed, int width, int depth);
+void recordEvent (struct InputRecorder &rec, long tick, const struct InputEvent &event);
+
+/* Write the end marker at tick and close; returns 0 if the file couldn't be written */
+int recordClose (struct InputRecorder &rec, long tick);
+
+struct RecordedEvent {
+	long tick;
+	struct InputEvent event;
+};
+
+struct InputReplay {
+	uint64_t seed;
+	int width, depth;
+	long endTick; // the recording stopped here
+	std::vector<struct RecordedEvent> events;
+	size_t next; // first event not handed out yet
+};
+
+/* Read a whole recording; 0 if it is missing, not a recording, cut short,
+   or made on a grid --grid would not accept */
+int replayLoad (struct InputReplay &replay, const char* path);
+
+/* The next event due at tick, one per call; 0 when there are no more for it */
+int replayNext (struct InputReplay &replay, long tick, struct InputEvent &event);
+
+#endif
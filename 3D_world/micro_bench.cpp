@@ -0,0 +1,384 @@
+/* Micro-benchmarks for the per-tick and per-frame hot paths. Each one is run
+   in batches sized to take a few milliseconds; the median and the median
+   absolute deviation of BENCH_SAMPLES batches are reported, with samples
+   further than BENCH_REJECT scaled MADs from the median dropped from the
+   mean. Results can be written as JSON and compared against a stored run:
+
+     make micro_bench
+     ./micro_bench --json baseline.json
+     ./micro_bench --compare baseline.json
+
+   Comparing exits with status 1 on a regression or when the baseline has no
+   entry for a benchmark that ran, and with 2 if the baseline can't be read. */
+
+#include "simulation.h"
+#include "oscillate.h"
+#include "vertex_format.h"
+#include "offscreen.h"
+#include "rng.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace std;
+
+#define BENCH_SAMPLES 31
+#define BENCH_SAMPLE_SECONDS 0.002 // batches are grown until one takes this long
+#define BENCH_REJECT 3.0           // outlier cut, in MADs scaled to a normal sigma (1.4826)
+#define BENCH_GRID 256
+#define BENCH_POSITIONS 1024
+
+struct BenchResult {
+	char name[64];
+	double median, mad, mean; // nanoseconds per call
+	int samples, outliers;
+	long iterations; // calls per sample
+};
+
+static double seconds ()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static volatile float Sink; // results go here so the work isn't optimized away
+
+static double median (vector<double> v)
+{
+	sort(v.begin(), v.end());
+	size_t n = v.size();
+	return n % 2 ? v[n/2] : 0.5*(v[n/2 - 1] + v[n/2]);
+}
+
+static struct BenchResult bench (const char* name, void (*run)(long iterations))
+{
+	long iterations = 1;
+	while (iterations < (1L << 30)) {
+		double start = seconds();
+		run(iterations);
+		if (seconds() - start >= BENCH_SAMPLE_SECONDS)
+			break;
+		iterations *= 2;
+	}
+	run(iterations); // warm up at the final size
+
+	vector<double> ns(BENCH_SAMPLES);
+	for (int s=0; s<BENCH_SAMPLES; s++) {
+		double start = seconds();
+		run(iterations);
+		ns[s] = 1e9*(seconds() - start)/iterations;
+	}
+
+	struct BenchResult r;
+	snprintf(r.name, sizeof(r.name), "%s", name);
+	r.median = median(ns);
+	vector<double> deviation(BENCH_SAMPLES);
+	for (int s=0; s<BENCH_SAMPLES; s++)
+		deviation[s] = fabs(ns[s] - r.median);
+	r.mad = median(deviation);
+
+	double sum = 0;
+	int kept = 0;
+	for (int s=0; s<BENCH_SAMPLES; s++)
+		if (deviation[s] <= BENCH_REJECT*1.4826*r.mad) {
+			sum += ns[s];
+			kept++;
+		}
+	r.mean = sum/kept; // the median itself is always kept
+	r.samples = BENCH_SAMPLES;
+	r.outliers = BENCH_SAMPLES - kept;
+	r.iterations = iterations;
+	return r;
+}
+
+/* Simulation: a 256x256 world a few block waves in, and player positions
+   spread over it */
+
+static vector<float> Pos_x, Pos_z;
+
+static void setupWorld ()
+{
+	Grid_width = Grid_depth = BENCH_GRID;
+	Seed = 1;
+	zero();
+	for (int k=0; k<SIM_HZ; k++)
+		simulationStep();
+
+	struct Rng rng;
+	rngSeed(rng, 2);
+	Pos_x.resize(BENCH_POSITIONS);
+	Pos_z.resize(BENCH_POSITIONS);
+	for (int k=0; k<BENCH_POSITIONS; k++) {
+		Pos_x[k] = rngBelow(rng, 1000*(BENCH_GRID-1)) / 1000.0f;
+		Pos_z[k] = -(rngBelow(rng, 1000*(BENCH_GRID-1)) / 1000.0f);
+	}
+}
+
+/* check_Pos_X/check_Pos_Z became movePlayer's sweep against the blocks */
+static void benchMovePlayer (long iterations)
+{
+	for (long k=0; k<iterations; k++) {
+		int p = k & (BENCH_POSITIONS - 1);
+		Player_X = Pos_x[p];
+		Player_Z = Pos_z[p];
+		movePlayer(p & 1 ? 0.2f : 0, p & 1 ? 0 : -0.2f);
+		Sink = Player_X + Player_Z;
+	}
+}
+
+/* Both checks run in full while Player_fall is set, the fall they would start
+   is a no-op; it is put back so the benchmarks after these see a standing player */
+static void benchPlayerFall (long iterations)
+{
+	int fall = Player_fall;
+	Player_fall = 1;
+	for (long k=0; k<iterations; k++) {
+		int p = k & (BENCH_POSITIONS - 1);
+		Player_X = Pos_x[p];
+		Player_Z = Pos_z[p];
+		check_Player_fall();
+	}
+	Player_fall = fall;
+}
+
+static void benchPlayerObstacle (long iterations)
+{
+	int fall = Player_fall;
+	Player_fall = 1;
+	for (long k=0; k<iterations; k++) {
+		int p = k & (BENCH_POSITIONS - 1);
+		Player_X = Pos_x[p];
+		Player_Z = Pos_z[p];
+		check_player_obstacle();
+	}
+	Player_fall = fall;
+}
+
+/* The block animation kernel, one tick over a 256x256 batch with the game's
+   5% of cells in a wave; the simulation now runs it over the moving blocks only */
+static void benchOscillate (long iterations)
+{
+	static vector<float> height, direction;
+	static vector<int> finished;
+	if (height.empty()) {
+		height.assign(BENCH_GRID*BENCH_GRID, 0);
+		direction.assign(height.size(), 0);
+		for (size_t c=0; c<direction.size(); c+=20)
+			direction[c] = 1; // the game's 5% of cells in a wave
+	}
+	for (long k=0; k<iterations; k++) {
+		finished.clear();
+		oscillateStep(&height[0], &direction[0], height.size(), 0.01f, 0, 2.0f, finished);
+	}
+	Sink = height[0];
+}
+
+static void benchSimulationStep (long iterations)
+{
+	for (long k=0; k<iterations; k++)
+		simulationStep();
+	Sink = Block_cells.size();
+}
+
+/* Rendering: the per-draw MVP of the non-UBO path */
+static void benchMVP (long iterations)
+{
+	glm::mat4 projection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, -10.0f, 10.0f);
+	glm::mat4 view = glm::lookAt(glm::vec3(1, 1, 1), glm::vec3(0, 0, 0), glm::vec3(0, 1, 0));
+	float sum = 0;
+	for (long k=0; k<iterations; k++) {
+		int p = k & (BENCH_POSITIONS - 1);
+		glm::mat4 VP = projection * view;
+		glm::mat4 MVP = VP * glm::translate(glm::vec3(Pos_x[p], 0, Pos_z[p]));
+		sum += MVP[3][0];
+	}
+	Sink = sum;
+}
+
+/* The game's block: 12 triangles as a strip of 36 vertices */
+static GLfloat Cube_vertices[3*36], Cube_colors[3*36];
+
+static void setupCube ()
+{
+	for (int v=0; v<36; v++)
+		for (int c=0; c<3; c++) {
+			int corner = (v*7 + c*3) % 8; // any 8 corners repeated, enough for dedup to matter
+			Cube_vertices[3*v + c] = (corner >> c) & 1 ? 0.5f : -0.5f;
+			Cube_colors[3*v + c] = c/3.0f;
+		}
+}
+
+static void benchPackVertices (long iterations)
+{
+	struct PackedVertices packed;
+	packed.numVertices = 0;
+	for (long k=0; k<iterations; k++)
+		packVertices(VERTEX_INTERLEAVED | VERTEX_INDEXED | VERTEX_POS_HALF, 36, Cube_vertices, Cube_colors, packed);
+	Sink = packed.numVertices;
+}
+
+/* What create3DObject does for a new mesh: pack, then VAO, VBO and IBO
+   uploads. Finishes the batch so the driver's copy is counted. */
+static void benchUpload (long iterations)
+{
+	struct PackedVertices packed;
+	for (long k=0; k<iterations; k++) {
+		packVertices(VERTEX_INTERLEAVED | VERTEX_INDEXED | VERTEX_POS_HALF, 36, Cube_vertices, Cube_colors, packed);
+		GLuint vao, buffers[2];
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(2, buffers);
+		glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+		glBufferData(GL_ARRAY_BUFFER, packed.vertices.size(), &packed.vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, packed.indices.size(), &packed.indices[0], GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		glDeleteBuffers(2, buffers);
+		glDeleteVertexArrays(1, &vao);
+	}
+	glFinish();
+}
+
+static void writeJSON (FILE* file, const vector<struct BenchResult> &results)
+{
+	fprintf(file, "{\"benchmarks\": [\n");
+	for (size_t k=0; k<results.size(); k++) {
+		const struct BenchResult &r = results[k];
+		fprintf(file, "  {\"name\": \"%s\", \"median_ns\": %.4f, \"mad_ns\": %.4f, \"mean_ns\": %.4f, \"samples\": %d, \"outliers\": %d, \"iterations\": %ld}%s\n",
+			r.name, r.median, r.mad, r.mean, r.samples, r.outliers, r.iterations, k+1 < results.size() ? "," : "");
+	}
+	fprintf(file, "]}\n");
+}
+
+/* Reads back what writeJSON wrote: one benchmark per line; 0 if the file is
+   missing or holds none */
+static int readJSON (const char* path, vector<struct BenchResult> &results)
+{
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return 0;
+	char line[512];
+	while (fgets(line, sizeof(line), file)) {
+		struct BenchResult r;
+		const char* name = strstr(line, "\"name\": \"");
+		const char* med = strstr(line, "\"median_ns\": ");
+		const char* mad = strstr(line, "\"mad_ns\": ");
+		if (name == NULL || med == NULL || mad == NULL || sscanf(name + 9, "%63[^\"]", r.name) != 1
+			|| sscanf(med + 13, "%lf", &r.median) != 1 || sscanf(mad + 10, "%lf", &r.mad) != 1)
+			continue;
+		results.push_back(r);
+	}
+	fclose(file);
+	return !results.empty();
+}
+
+/* A regression is slower by more than threshold and by more than the noise
+   of both runs; returns how many benchmarks regressed or had no baseline */
+static int compare (const vector<struct BenchResult> &baseline, const vector<struct BenchResult> &results, double threshold)
+{
+	int regressions = 0;
+	printf("\n%-24s %12s %12s %8s\n", "compared to baseline", "before ns", "now ns", "change");
+	for (size_t k=0; k<results.size(); k++) {
+		const struct BenchResult* base = NULL;
+		for (size_t b=0; b<baseline.size(); b++)
+			if (strcmp(baseline[b].name, results[k].name) == 0)
+				base = &baseline[b];
+		if (base == NULL) {
+			printf("%-24s %12s %12.2f %8s  NOT IN BASELINE\n", results[k].name, "-", results[k].median, "");
+			regressions++;
+			continue;
+		}
+		double change = results[k].median/base->median - 1;
+		double noise = BENCH_REJECT*1.4826*(results[k].mad + base->mad);
+		const char* verdict = "";
+		if (change > threshold && results[k].median - base->median > noise) {
+			verdict = "  REGRESSION";
+			regressions++;
+		}
+		else if (change < -threshold && base->median - results[k].median > noise)
+			verdict = "  faster";
+		printf("%-24s %12.2f %12.2f %+7.1f%%%s\n", results[k].name, base->median, results[k].median, 100*change, verdict);
+	}
+	return regressions;
+}
+
+int main (int argc, char** argv)
+{
+	const char* json = NULL;
+	const char* baseline_path = NULL;
+	const char* filter = "";
+	double threshold = 0.05;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--json") == 0 && i+1 < argc)
+			json = argv[++i];
+		else if (strcmp(argv[i], "--compare") == 0 && i+1 < argc)
+			baseline_path = argv[++i];
+		else if (strcmp(argv[i], "--threshold") == 0 && i+1 < argc)
+			threshold = atof(argv[++i]);
+		else if (strcmp(argv[i], "--filter") == 0 && i+1 < argc)
+			filter = argv[++i];
+		else {
+			fprintf(stderr, "usage: %s [--json results.json] [--compare baseline.json] [--threshold 0.05] [--filter name]\n", argv[0]);
+			return 2;
+		}
+	}
+	vector<struct BenchResult> baseline;
+	if (baseline_path != NULL && !readJSON(baseline_path, baseline)) {
+		fprintf(stderr, "Could not read any benchmarks from %s\n", baseline_path);
+		return 2;
+	}
+
+	setupWorld();
+	setupCube();
+	bool gl = offscreenInit(64, 64);
+	if (!gl)
+		printf("No offscreen GL context, skipping the upload benchmark\n");
+
+	struct {
+		const char* name;
+		void (*run)(long);
+		bool needsGL;
+	} benches[] = {
+		{"movePlayer", benchMovePlayer, false},
+		{"check_Player_fall", benchPlayerFall, false},
+		{"check_player_obstacle", benchPlayerObstacle, false},
+		{"oscillate_256x256", benchOscillate, false},
+		{"simulationStep_256x256", benchSimulationStep, false},
+		{"mvp", benchMVP, false},
+		{"packVertices_cube", benchPackVertices, false},
+		{"upload_cube", benchUpload, true},
+	};
+
+	vector<struct BenchResult> results;
+	printf("%-24s %12s %10s %8s %10s\n", "benchmark", "median ns", "MAD ns", "outliers", "calls");
+	for (size_t b=0; b<sizeof(benches)/sizeof(benches[0]); b++) {
+		if (!strstr(benches[b].name, filter) || (benches[b].needsGL && !gl))
+			continue;
+		struct BenchResult r = bench(benches[b].name, benches[b].run);
+		printf("%-24s %12.2f %10.2f %5d/%-2d %10ld\n", r.name, r.median, r.mad, r.outliers, r.samples, r.iterations);
+		results.push_back(r);
+	}
+	if (gl)
+		offscreenTerminate();
+
+	if (json != NULL) {
+		FILE* file = fopen(json, "w");
+		if (file == NULL) {
+			fprintf(stderr, "Could not write %s\n", json);
+			return 2;
+		}
+		writeJSON(file, results);
+		fclose(file);
+	}
+	if (baseline_path != NULL && compare(baseline, results, threshold) > 0)
+		return 1;
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "occlusion.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+struct ScreenPoint {
+	float x, y, z; // pixels, pixels, depth in [0,1]
+	bool clipped;  // behind the eye or in front of the near plane
+};
+
+static const int TILES_X = OCCLUSION_WIDTH / OCCLUSION_TILE;
+static const int TILES_Y = OCCLUSION_HEIGHT / OCCLUSION_TILE;
+
+static void boxCorners (const float* m, const float* boxmin, const float* boxmax, struct ScreenPoint corners[8])
+{
+	for (int k=0; k<8; k++) {
+		float p[3] = { (k & 1) ? boxmax[0] : boxmin[0], (k & 2) ? boxmax[1] : boxmin[1], (k & 4) ? boxmax[2] : boxmin[2] };
+		float clip[4];
+		for (int r=0; r<4; r++)
+			clip[r] = m[r]*p[0] + m[4+r]*p[1] + m[8+r]*p[2] + m[12+r];
+
+		struct ScreenPoint &s = corners[k];
+		s.clipped = clip[3] <= 1e-6f;
+		if (s.clipped)
+			continue;
+		float x = clip[0]/clip[3], y = clip[1]/clip[3], z = clip[2]/clip[3];
+		s.clipped = z < -1.0f;
+		s.x = (x*0.5f + 0.5f) * OCCLUSION_WIDTH;
+		s.y = (y*0.5f + 0.5f) * OCCLUSION_HEIGHT;
+		s.z = min(max(z*0.5f + 0.5f, 0.0f), 1.0f);
+	}
+}
+
+void occlusionClear (struct OcclusionBuffer &buffer)
+{
+	buffer.depth.assign(OCCLUSION_WIDTH*OCCLUSION_HEIGHT, 1.0f);
+	buffer.hiz.assign(TILES_X*TILES_Y, 1.0f);
+}
+
+/* Depth-tested fill of the pixels whose centers lie inside the triangle */
+static void rasterTriangle (struct OcclusionBuffer &buffer, const struct ScreenPoint &a, const struct ScreenPoint &b, const struct ScreenPoint &c)
+{
+	float area = (b.x - a.x)*(c.y - a.y) - (b.y - a.y)*(c.x - a.x);
+	if (fabs(area) < 1e-8f)
+		return;
+
+	int x0 = max(0, (int) floor(min(a.x, min(b.x, c.x))));
+	int x1 = min(OCCLUSION_WIDTH-1, (int) ceil(max(a.x, max(b.x, c.x))));
+	int y0 = max(0, (int) floor(min(a.y, min(b.y, c.y))));
+	int y1 = min(OCCLUSION_HEIGHT-1, (int) ceil(max(a.y, max(b.y, c.y))));
+
+	for (int y=y0; y<=y1; y++) {
+		float py = y + 0.5f;
+		for (int x=x0; x<=x1; x++) {
+			float px = x + 0.5f;
+			// barycentric weights, sign-corrected so either winding works
+			float w0 = ((b.x - px)*(c.y - py) - (b.y - py)*(c.x - px)) / area;
+			float w1 = ((c.x - px)*(a.y - py) - (c.y - py)*(a.x - px)) / area;
+			float w2 = 1.0f - w0 - w1;
+			if (w0 < 0 || w1 < 0 || w2 < 0)
+				continue;
+			float z = w0*a.z + w1*b.z + w2*c.z;
+			float &d = buffer.depth[y*OCCLUSION_WIDTH + x];
+			if (z < d)
+				d = z;
+		}
+	}
+}
+
+void occlusionAddBox (struct OcclusionBuffer &buffer, const float* m, const float* boxmin, const float* boxmax)
+{
+	struct ScreenPoint corners[8];
+	boxCorners(m, boxmin, boxmax, corners);
+	for (int k=0; k<8; k++)
+		if (corners[k].clipped)
+			return;
+
+	// corner index bits are (x,y,z); each face as two triangles
+	static const int faces[6][4] = {
+		{0, 1, 3, 2}, {4, 5, 7, 6}, // z min, z max
+		{0, 1, 5, 4}, {2, 3, 7, 6}, // y min, y max
+		{0, 2, 6, 4}, {1, 3, 7, 5}, // x min, x max
+	};
+	for (int f=0; f<6; f++) {
+		const int* q = faces[f];
+		rasterTriangle(buffer, corners[q[0]], corners[q[1]], corners[q[2]]);
+		rasterTriangle(buffer, corners[q[0]], corners[q[2]], corners[q[3]]);
+	}
+}
+
+void occlusionBuildHiZ (struct OcclusionBuffer &buffer)
+{
+	for (int ty=0; ty<TILES_Y; ty++) {
+		for (int tx=0; tx<TILES_X; tx++) {
+			float far_depth = 0;
+			for (int y=ty*OCCLUSION_TILE; y<(ty+1)*OCCLUSION_TILE; y++)
+				for (int x=tx*OCCLUSION_TILE; x<(tx+1)*OCCLUSION_TILE; x++)
+					far_depth = max(far_depth, buffer.depth[y*OCCLUSION_WIDTH + x]);
+			buffer.hiz[ty*TILES_X + tx] = far_depth;
+		}
+	}
+}
+
+bool occlusionTestBox (const struct OcclusionBuffer &buffer, const float* m, const float* boxmin, const float* boxmax)
+{
+	struct ScreenPoint corners[8];
+	boxCorners(m, boxmin, boxmax, corners);
+
+	float xmin = corners[0].x, xmax = xmin, ymin = corners[0].y, ymax = ymin, znear = 1.0f;
+	for (int k=0; k<8; k++) {
+		if (corners[k].clipped)
+			return false; // crosses the eye or near plane, keep it
+		xmin = min(xmin, corners[k].x);
+		xmax = max(xmax, corners[k].x);
+		ymin = min(ymin, corners[k].y);
+		ymax = max(ymax, corners[k].y);
+		znear = min(znear, corners[k].z);
+	}
+
+	// anything reaching outside the buffer may be visible there
+	if (xmin < 0 || ymin < 0 || xmax >= OCCLUSION_WIDTH || ymax >= OCCLUSION_HEIGHT)
+		return false;
+
+	int tx0 = (int) xmin / OCCLUSION_TILE, tx1 = (int) xmax / OCCLUSION_TILE;
+	int ty0 = (int) ymin / OCCLUSION_TILE, ty1 = (int) ymax / OCCLUSION_TILE;
+	for (int ty=ty0; ty<=ty1; ty++)
+		for (int tx=tx0; tx<=tx1; tx++)
+			if (buffer.hiz[ty*TILES_X + tx] >= znear)
+				return false;
+	return true;
+}
+
+float occlusionBoxNearDepth (const float* m, const float* boxmin, const float* boxmax)
+{
+	struct ScreenPoint corners[8];
+	boxCorners(m, boxmin, boxmax, corners);
+	float znear = 1.0f;
+	for (int k=0; k<8; k++)
+		if (!corners[k].clipped)
+			znear = min(znear, corners[k].z);
+	return znear;
+}
@@ -0,0 +1,34 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <vector>
+
+/* Small software depth buffer for occlusion culling on the CPU. A few
+   near occluders are rasterized into it, then a coarse max-depth level
+   (hierarchical Z) answers "is this box entirely behind what's drawn". */
+
+#define OCCLUSION_WIDTH  256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE   8 // pixels per side of one hierarchical Z tile
+
+struct OcclusionBuffer {
+	std::vector<float> depth; // [0,1], 1 is the far plane
+	std::vector<float> hiz;   // farthest depth of each tile
+};
+
+void occlusionClear (struct OcclusionBuffer &buffer);
+
+/* Rasterize the 12 triangles of a box through the column-major matrix m.
+   Boxes crossing the near plane are skipped, as GL would clip them. */
+void occlusionAddBox (struct OcclusionBuffer &buffer, const float* m, const float* boxmin, const float* boxmax);
+
+/* Refresh the hierarchical level after the occluders are in */
+void occlusionBuildHiZ (struct OcclusionBuffer &buffer);
+
+/* True when the box is hidden: its nearest point is behind every tile it covers */
+bool occlusionTestBox (const struct OcclusionBuffer &buffer, const float* m, const float* boxmin, const float* boxmax);
+
+/* Nearest NDC depth of a box, used to pick the occluders closest to the camera */
+float occlusionBoxNearDepth (const float* m, const float* boxmin, const float* boxmax);
+
+#endif
@@ -0,0 +1,112 @@
+#include "occupancy.h"
+
+void bitGridInit (struct BitGrid &grid, int width, int depth)
+{
+	grid.width = width;
+	grid.depth = depth;
+	grid.words = (depth + 63) / 64;
+	grid.bits.assign((size_t)width*grid.words, 0);
+}
+
+void bitGridClear (struct BitGrid &grid)
+{
+	grid.bits.assign(grid.bits.size(), 0);
+}
+
+/* Bits j0..j1 of word w (which holds bits 64*w .. 64*w+63) */
+static uint64_t spanMask (int w, int j0, int j1)
+{
+	int lo = j0 - 64*w, hi = j1 - 64*w;
+	if (hi < 0 || lo > 63)
+		return 0;
+	uint64_t mask = ~(uint64_t)0;
+	if (lo > 0)
+		mask &= ~(uint64_t)0 << lo;
+	if (hi < 63)
+		mask &= ~(uint64_t)0 >> (63 - hi);
+	return mask;
+}
+
+int bitGridCount (const struct BitGrid &grid, int i0, int i1, int j0, int j1)
+{
+	int count = 0;
+	for (int i=i0; i<=i1; i++)
+		for (int w=j0 >> 6; w<=(j1 >> 6); w++)
+			count += __builtin_popcountll(grid.bits[i*grid.words + w] & spanMask(w, j0, j1));
+	return count;
+}
+
+void bitGridFree (struct BitGrid &out, const struct BitGrid &a, const struct BitGrid &b, int i0, int i1, int j0, int j1)
+{
+	bitGridClear(out);
+	for (int i=i0; i<=i1; i++)
+		for (int w=j0 >> 6; w<=(j1 >> 6); w++) {
+			size_t k = i*out.words + w;
+			out.bits[k] = ~(a.bits[k] | b.bits[k]) & spanMask(w, j0, j1);
+		}
+}
+
+int bitGridSelect (const struct BitGrid &grid, int n, int* i, int* j)
+{
+	for (size_t k=0; k<grid.bits.size(); k++) {
+		uint64_t word = grid.bits[k];
+		int count = __builtin_popcountll(word);
+		if (n >= count) {
+			n -= count;
+			continue;
+		}
+		// drop the lowest n set bits, the next one is the answer
+		for (; n>0; n--)
+			word &= word - 1;
+		*i = k / grid.words;
+		*j = (k % grid.words)*64 + __builtin_ctzll(word);
+		return 1;
+	}
+	return 0;
+}
+
+int bitGridSample (struct BitGrid &grid, int k, struct Rng &rng, int* is, int* js)
+{
+	int available = bitGridCount(grid, 0, grid.width-1, 0, grid.depth-1);
+	if (k > available)
+		k = available;
+
+	// a few cells: select each one directly
+	if ((double)k*grid.bits.size() < available) {
+		for (int n=0; n<k; n++, available--) {
+			bitGridSelect(grid, rngBelow(rng, available), &is[n], &js[n]);
+			bitSet(grid, is[n], js[n], 0);
+		}
+		return k;
+	}
+
+	// many cells: one pass over the set bits, keeping each with probability needed/left
+	// (Knuth's selection sampling), so the cost stays O(cells/64 + set cells)
+	int n = 0;
+	for (size_t w=0; w<grid.bits.size() && n<k; w++) {
+		uint64_t word = grid.bits[w];
+		for (; word && n<k; word &= word - 1, available--) {
+			if ((int)rngBelow(rng, available) >= k - n)
+				continue;
+			is[n] = w / grid.words;
+			js[n] = (w % grid.words)*64 + __builtin_ctzll(word);
+			grid.bits[w] &= ~(word & -word);
+			n++;
+		}
+	}
+	return n;
+}
+
+int bitGridFind (const struct BitGrid &grid, int i0, int i1, int j0, int j1, int* hiti, int* hitj)
+{
+	for (int i=i0; i<=i1; i++)
+		for (int w=j0 >> 6; w<=(j1 >> 6); w++) {
+			uint64_t word = grid.bits[i*grid.words + w] & spanMask(w, j0, j1);
+			if (word) {
+				*hiti = i;
+				*hitj = 64*w + __builtin_ctzll(word);
+				return 1;
+			}
+		}
+	return 0;
+}
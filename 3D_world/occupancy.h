@@ -0,0 +1,49 @@
+#ifndef OCCUPANCY_H
+#define OCCUPANCY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "rng.h"
+
+/* One bit per grid cell, cell (i,j) is bit j of row i. Rows are padded to whole
+   64 bit words so layers of the same size can be combined a word at a time. */
+struct BitGrid {
+	int width, depth; // cells along x (rows) and along -z (bits per row)
+	int words; // words per row
+	std::vector<uint64_t> bits;
+};
+
+void bitGridInit (struct BitGrid &grid, int width, int depth);
+void bitGridClear (struct BitGrid &grid);
+
+inline int bitGet (const struct BitGrid &grid, int i, int j)
+{
+	return (grid.bits[i*grid.words + (j >> 6)] >> (j & 63)) & 1;
+}
+
+inline void bitSet (struct BitGrid &grid, int i, int j, int value)
+{
+	uint64_t &word = grid.bits[i*grid.words + (j >> 6)];
+	uint64_t mask = (uint64_t)1 << (j & 63);
+	word = value ? (word | mask) : (word & ~mask);
+}
+
+/* Set cells inside the rectangle [i0,i1] x [j0,j1] (inclusive) */
+int bitGridCount (const struct BitGrid &grid, int i0, int i1, int j0, int j1);
+
+/* out = cells in [i0,i1] x [j0,j1] that are set in neither a nor b */
+void bitGridFree (struct BitGrid &out, const struct BitGrid &a, const struct BitGrid &b, int i0, int i1, int j0, int j1);
+
+/* Cell of the n-th set bit in row-major order (n from 0), 0 if there are not that many */
+int bitGridSelect (const struct BitGrid &grid, int n, int* i, int* j);
+
+/* Pick up to k distinct set cells uniformly at random, clearing them from the grid,
+   and return how many it found. Runs in O(min(k * cells/64, cells/64 + set cells))
+   whatever the fill. */
+int bitGridSample (struct BitGrid &grid, int k, struct Rng &rng, int* is, int* js);
+
+/* First set cell in [i0,i1] x [j0,j1] in (i,j) order, 0 if none */
+int bitGridFind (const struct BitGrid &grid, int i0, int i1, int j0, int j1, int* hiti, int* hitj);
+
+#endif
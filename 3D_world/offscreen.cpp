@@ -0,0 +1,145 @@
+#include "offscreen.h"
+
+#include <stdio.h>
+#include <vector>
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+using namespace std;
+
+static EGLDisplay Display = EGL_NO_DISPLAY;
+static EGLContext Context = EGL_NO_CONTEXT;
+static EGLSurface Surface = EGL_NO_SURFACE;
+static GLuint Framebuffer, ColorBuffer, DepthBuffer;
+static int Width, Height;
+
+static EGLDisplay openDisplay ()
+{
+	// Prefer the surfaceless platform: no X, no DRM device needed
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay != NULL) {
+		EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+			return display;
+	}
+	EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (display != EGL_NO_DISPLAY && eglInitialize(display, NULL, NULL))
+		return display;
+	return EGL_NO_DISPLAY;
+}
+
+bool offscreenInit (int width, int height)
+{
+	Width = width;
+	Height = height;
+
+	Display = openDisplay();
+	if (Display == EGL_NO_DISPLAY) {
+		fprintf(stderr, "Offscreen: no EGL display\n");
+		return false;
+	}
+	if (!eglBindAPI(EGL_OPENGL_API)) {
+		fprintf(stderr, "Offscreen: EGL has no desktop OpenGL\n");
+		return false;
+	}
+
+	const EGLint config_attribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint num_configs = 0;
+	if (!eglChooseConfig(Display, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+		fprintf(stderr, "Offscreen: no EGL config\n");
+		return false;
+	}
+
+	const EGLint context_attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	Context = eglCreateContext(Display, config, EGL_NO_CONTEXT, context_attribs);
+	if (Context == EGL_NO_CONTEXT) {
+		fprintf(stderr, "Offscreen: could not create a GL 3.3 core context\n");
+		return false;
+	}
+
+	// Surfaceless if the driver allows it, else a tiny pbuffer; we draw to the FBO either way
+	if (!eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, Context)) {
+		const EGLint pbuffer_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+		Surface = eglCreatePbufferSurface(Display, config, pbuffer_attribs);
+		if (Surface == EGL_NO_SURFACE || !eglMakeCurrent(Display, Surface, Surface, Context)) {
+			fprintf(stderr, "Offscreen: could not make the context current\n");
+			return false;
+		}
+	}
+
+	if (!gladLoadGLLoader((GLADloadproc) eglGetProcAddress)) {
+		fprintf(stderr, "Offscreen: could not load GL functions\n");
+		return false;
+	}
+
+	glGenRenderbuffers(1, &ColorBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, ColorBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &DepthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, DepthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, ColorBuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, DepthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Offscreen: framebuffer incomplete\n");
+		return false;
+	}
+
+	printf("Offscreen: %s, %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+	return true;
+}
+
+void offscreenSwap ()
+{
+	glFinish();
+}
+
+bool offscreenWritePPM (const char* path)
+{
+	vector<unsigned char> pixels(3*Width*Height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+	FILE* file = fopen(path, "wb");
+	if (file == NULL)
+		return false;
+	fprintf(file, "P6\n%d %d\n255\n", Width, Height);
+	// GL rows start at the bottom, PPM rows at the top
+	for (int y=Height-1; y>=0; y--)
+		fwrite(&pixels[3*y*Width], 1, 3*Width, file);
+	fclose(file);
+	return true;
+}
+
+void offscreenTerminate ()
+{
+	if (Display == EGL_NO_DISPLAY)
+		return;
+	if (Context != EGL_NO_CONTEXT) {
+		glDeleteFramebuffers(1, &Framebuffer);
+		glDeleteRenderbuffers(1, &ColorBuffer);
+		glDeleteRenderbuffers(1, &DepthBuffer);
+	}
+	eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (Surface != EGL_NO_SURFACE)
+		eglDestroySurface(Display, Surface);
+	if (Context != EGL_NO_CONTEXT)
+		eglDestroyContext(Display, Context);
+	eglTerminate(Display);
+	Display = EGL_NO_DISPLAY;
+}
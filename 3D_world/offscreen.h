@@ -0,0 +1,21 @@
+#ifndef OFFSCREEN_H
+#define OFFSCREEN_H
+
+/* Windowless GL 3.3 core context through EGL, rendering into an FBO.
+   Works on machines without a display or GPU when Mesa's llvmpipe is
+   installed (surfaceless platform, falling back to a pbuffer). */
+
+/* Create the context and a width x height FBO, load GL and bind the FBO.
+   Returns false if no usable EGL/GL 3.3 setup was found. */
+bool offscreenInit (int width, int height);
+
+/* Stand-in for glfwSwapBuffers: waits for the frame to finish so frame
+   times measure the whole frame */
+void offscreenSwap ();
+
+/* Write the current FBO contents as a binary PPM, bottom row last */
+bool offscreenWritePPM (const char* path);
+
+void offscreenTerminate ();
+
+#endif
@@ -0,0 +1,120 @@
+#include "oscillate.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OSCILLATE_X86
+#include <immintrin.h>
+#endif
+
+/* Reference version, also used for the tail the vector loops leave over */
+static int stepScalar (float* height, float* direction, int begin, int count, float step, float low, float high, std::vector<int> &finished)
+{
+	int done = 0;
+	for (int k=begin; k<count; k++) {
+		float d = direction[k];
+		float h = height[k] + d*step;
+		if (d > 0 && h >= high)
+			d = -1;
+		else if (d < 0 && h <= low) {
+			h = low;
+			d = 0;
+			finished.push_back(k);
+			done++;
+		}
+		height[k] = h;
+		direction[k] = d;
+	}
+	return done;
+}
+
+#ifdef OSCILLATE_X86
+
+__attribute__((target("sse2")))
+static int stepSse (float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished)
+{
+	const __m128 vstep = _mm_set1_ps(step), vlow = _mm_set1_ps(low), vhigh = _mm_set1_ps(high);
+	const __m128 zero = _mm_setzero_ps(), minus = _mm_set1_ps(-1.0f);
+	int done = 0, k = 0;
+	for (; k+4<=count; k+=4) {
+		__m128 d = _mm_loadu_ps(direction + k);
+		__m128 h = _mm_add_ps(_mm_loadu_ps(height + k), _mm_mul_ps(d, vstep));
+		__m128 turn = _mm_and_ps(_mm_cmpgt_ps(d, zero), _mm_cmpge_ps(h, vhigh));
+		__m128 stop = _mm_and_ps(_mm_cmplt_ps(d, zero), _mm_cmple_ps(h, vlow));
+		d = _mm_or_ps(_mm_andnot_ps(turn, d), _mm_and_ps(turn, minus));
+		d = _mm_andnot_ps(stop, d);
+		h = _mm_or_ps(_mm_andnot_ps(stop, h), _mm_and_ps(stop, vlow));
+		_mm_storeu_ps(height + k, h);
+		_mm_storeu_ps(direction + k, d);
+
+		int mask = _mm_movemask_ps(stop);
+		for (; mask; mask &= mask - 1, done++)
+			finished.push_back(k + __builtin_ctz(mask));
+	}
+	return done + stepScalar(height, direction, k, count, step, low, high, finished);
+}
+
+__attribute__((target("avx2")))
+static int stepAvx2 (float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished)
+{
+	const __m256 vstep = _mm256_set1_ps(step), vlow = _mm256_set1_ps(low), vhigh = _mm256_set1_ps(high);
+	const __m256 zero = _mm256_setzero_ps(), minus = _mm256_set1_ps(-1.0f);
+	int done = 0, k = 0;
+	for (; k+8<=count; k+=8) {
+		__m256 d = _mm256_loadu_ps(direction + k);
+		__m256 h = _mm256_add_ps(_mm256_loadu_ps(height + k), _mm256_mul_ps(d, vstep));
+		__m256 turn = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_GT_OQ), _mm256_cmp_ps(h, vhigh, _CMP_GE_OQ));
+		__m256 stop = _mm256_and_ps(_mm256_cmp_ps(d, zero, _CMP_LT_OQ), _mm256_cmp_ps(h, vlow, _CMP_LE_OQ));
+		d = _mm256_blendv_ps(d, minus, turn);
+		d = _mm256_blendv_ps(d, zero, stop);
+		h = _mm256_blendv_ps(h, vlow, stop);
+		_mm256_storeu_ps(height + k, h);
+		_mm256_storeu_ps(direction + k, d);
+
+		int mask = _mm256_movemask_ps(stop);
+		for (; mask; mask &= mask - 1, done++)
+			finished.push_back(k + __builtin_ctz(mask));
+	}
+	return done + stepScalar(height, direction, k, count, step, low, high, finished);
+}
+
+#endif
+
+int oscillatePath ()
+{
+	static int path = -1;
+	if (path < 0) {
+		path = OSCILLATE_SCALAR;
+#ifdef OSCILLATE_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2"))
+			path = OSCILLATE_AVX2;
+		else if (__builtin_cpu_supports("sse2"))
+			path = OSCILLATE_SSE;
+#endif
+	}
+	return path;
+}
+
+const char* oscillatePathName (int path)
+{
+	switch (path) {
+		case OSCILLATE_AVX2: return "avx2";
+		case OSCILLATE_SSE: return "sse";
+		default: return "scalar";
+	}
+}
+
+int oscillateStepPath (int path, float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished)
+{
+#ifdef OSCILLATE_X86
+	if (path == OSCILLATE_AVX2)
+		return stepAvx2(height, direction, count, step, low, high, finished);
+	if (path == OSCILLATE_SSE)
+		return stepSse(height, direction, count, step, low, high, finished);
+#endif
+	return stepScalar(height, direction, 0, count, step, low, high, finished);
+}
+
+int oscillateStep (float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished)
+{
+	return oscillateStepPath(oscillatePath(), height, direction, count, step, low, high, finished);
+}
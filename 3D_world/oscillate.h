@@ -0,0 +1,26 @@
+#ifndef OSCILLATE_H
+#define OSCILLATE_H
+
+#include <vector>
+
+/* Block oscillation over structure-of-arrays cells: height[k] moves by
+   direction[k]*step, where direction is +1 while the cell rises, -1 while it
+   sinks and 0 when it is idle. A rising cell turns round at high; a sinking
+   cell stops at low, goes idle and its index is appended to finished.
+   The SIMD versions replace the per-cell branches with compare masks. */
+
+#define OSCILLATE_SCALAR 0
+#define OSCILLATE_SSE 1
+#define OSCILLATE_AVX2 2
+
+/* Best path this CPU supports, checked once at runtime */
+int oscillatePath ();
+const char* oscillatePathName (int path);
+
+/* Step every cell with the best path; returns how many cells finished */
+int oscillateStep (float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished);
+
+/* One specific path, for testing and benchmarking; the path must be supported */
+int oscillateStepPath (int path, float* height, float* direction, int count, float step, float low, float high, std::vector<int> &finished);
+
+#endif
@@ -0,0 +1,57 @@
+/* Times the block oscillation kernel on each path the CPU supports and checks
+   they agree. Build with "make oscillate_bench" and run ./oscillate_bench */
+
+#include "oscillate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+static double seconds ()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench (int cells, int steps)
+{
+	// every cell animated, at random points of its cycle
+	vector<float> height0(cells), direction0(cells);
+	for (int k=0; k<cells; k++) {
+		height0[k] = 2.0f * (rand() / (float)RAND_MAX);
+		direction0[k] = (rand()%2) ? 1.0f : -1.0f;
+	}
+
+	vector<float> reference;
+	for (int path=OSCILLATE_SCALAR; path<=oscillatePath(); path++) {
+		vector<float> height = height0, direction = direction0;
+		vector<int> finished;
+		long total = 0;
+		double start = seconds();
+		for (int s=0; s<steps; s++) {
+			finished.clear();
+			total += oscillateStepPath(path, &height[0], &direction[0], cells, 0.01f, 0.0f, 2.0f, finished);
+		}
+		double elapsed = seconds() - start;
+
+		const char* check = "";
+		if (path == OSCILLATE_SCALAR)
+			reference = height;
+		else if (memcmp(&reference[0], &height[0], cells*sizeof(float)) != 0)
+			check = "  MISMATCH";
+		printf("%8d cells  %-6s %8.3f ms/step  %6.3f ns/cell  (%ld finished)%s\n", cells, oscillatePathName(path),
+			1e3*elapsed/steps, 1e9*elapsed/steps/cells, total, check);
+	}
+}
+
+int main ()
+{
+	srand(1);
+	bench(400, 10000);
+	bench(100000, 500);
+	bench(1000000, 50);
+	return 0;
+}
@@ -0,0 +1,125 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+
+int Profiling = 0;
+
+/* A slot's sequence is 0 while it is being written and ticket+1 once the
+   event of that ticket is in it, so a reader can tell a finished event from
+   one being overwritten. */
+struct ProfileSlot {
+	std::atomic<unsigned> sequence;
+	struct ProfileEvent event;
+};
+
+static struct ProfileSlot Ring[PROFILE_RING];
+static std::atomic<unsigned> Ring_head(0); // next ticket
+
+static const char* Track_names[PROFILE_TRACKS];
+static std::atomic<int> Track_count(0);
+
+// per thread: its track and its open sections
+static thread_local int Track = -1;
+static thread_local const char* Open_names[PROFILE_DEPTH];
+static thread_local double Open_starts[PROFILE_DEPTH];
+static thread_local int Depth = 0;
+
+double profileNow ()
+{
+	static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+int profileNamedTrack (const char* name)
+{
+	int track = Track_count.fetch_add(1);
+	if (track >= PROFILE_TRACKS)
+		track = PROFILE_TRACKS - 1; // share the last row rather than fail
+	else
+		Track_names[track] = name;
+	return track;
+}
+
+int profileTrack ()
+{
+	if (Track < 0)
+		Track = profileNamedTrack(NULL);
+	return Track;
+}
+
+void profileThreadName (const char* name)
+{
+	Track_names[profileTrack()] = name;
+}
+
+void profilePush (const struct ProfileEvent &event)
+{
+	unsigned ticket = Ring_head.fetch_add(1, std::memory_order_relaxed);
+	struct ProfileSlot &slot = Ring[ticket & (PROFILE_RING - 1)];
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.event = event;
+	slot.sequence.store(ticket + 1, std::memory_order_release);
+}
+
+void profileBegin (const char* name)
+{
+	if (!Profiling)
+		return;
+	if (Depth < PROFILE_DEPTH) {
+		Open_names[Depth] = name;
+		Open_starts[Depth] = profileNow();
+	}
+	Depth++;
+}
+
+void profileEnd ()
+{
+	if (!Profiling || Depth == 0)
+		return;
+	Depth--;
+	if (Depth >= PROFILE_DEPTH)
+		return; // too deep, dropped
+	struct ProfileEvent event;
+	event.name = Open_names[Depth];
+	event.track = profileTrack();
+	event.start = Open_starts[Depth];
+	event.end = profileNow();
+	profilePush(event);
+}
+
+int profileWriteTrace (const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+		return 0;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	int tracks = Track_count.load();
+	if (tracks > PROFILE_TRACKS)
+		tracks = PROFILE_TRACKS;
+	int written = 0;
+	for (int t=0; t<tracks; t++, written++)
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			written ? ",\n" : "", t, Track_names[t] ? Track_names[t] : "thread");
+
+	// oldest surviving ticket first; skip slots that are mid-write or already reused
+	unsigned head = Ring_head.load(std::memory_order_acquire);
+	unsigned first = head > PROFILE_RING ? head - PROFILE_RING : 0;
+	for (unsigned ticket=first; ticket!=head; ticket++) {
+		struct ProfileSlot &slot = Ring[ticket & (PROFILE_RING - 1)];
+		if (slot.sequence.load(std::memory_order_acquire) != ticket + 1)
+			continue;
+		struct ProfileEvent event = slot.event;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.sequence.load(std::memory_order_relaxed) != ticket + 1)
+			continue;
+		fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			written ? ",\n" : "", event.name, event.track, 1e6*event.start, 1e6*(event.end - event.start));
+		written++;
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	return fclose(file) == 0;
+}
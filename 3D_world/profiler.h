@@ -0,0 +1,42 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Scoped timing for the frame and the simulation. profileBegin/profileEnd
+   pairs record when a named section ran on the calling thread; finished
+   sections go into a lock-free ring shared by every thread, which keeps the
+   last PROFILE_RING of them and can be written out as a Chrome trace
+   (chrome://tracing or ui.perfetto.dev). Costs one flag test while
+   Profiling is 0. GPU times are added by gpu_timer.h. */
+
+#define PROFILE_RING 65536 // power of two
+#define PROFILE_DEPTH 16   // nesting per thread
+#define PROFILE_TRACKS 16  // threads (and the GPU) with their own row in the trace
+
+struct ProfileEvent {
+	const char* name; // a string literal, never copied
+	int track;        // thread that ran it, see profileTrack
+	double start, end; // seconds on profileNow's clock
+};
+
+extern int Profiling; // set before the first scope, e.g. from --trace
+
+/* Seconds since the profiler's epoch, on the steady clock */
+double profileNow ();
+
+/* This thread's track, given out on first use; name labels the row in the trace */
+int profileTrack ();
+void profileThreadName (const char* name);
+
+/* A track that isn't a thread, e.g. the GPU timeline */
+int profileNamedTrack (const char* name);
+
+void profileBegin (const char* name);
+void profileEnd ();
+
+/* Add an already timed section (wait-free, any thread) */
+void profilePush (const struct ProfileEvent &event);
+
+/* Write the ring as Chrome trace JSON; 0 if the file can't be written */
+int profileWriteTrace (const char* path);
+
+#endif
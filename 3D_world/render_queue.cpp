@@ -0,0 +1,66 @@
+#include "render_queue.h"
+
+#include <string.h>
+
+uint64_t renderKey (GLuint program, GLenum fill_mode, GLuint vao, float depth)
+{
+	// depth is NDC z in [-1,1]; map it onto an unsigned range so smaller is nearer
+	if (depth < -1) depth = -1;
+	if (depth > 1) depth = 1;
+	uint64_t d = (uint64_t) ((depth + 1.0f) * 0.5f * 4294967295.0f);
+
+	uint64_t key = 0;
+	key |= (uint64_t) (program & 0xff) << 56;
+	key |= (uint64_t) (fill_mode == GL_FILL ? 0 : 1) << 55;
+	key |= (uint64_t) (vao & 0x7fffff) << 32;
+	key |= d;
+	return key;
+}
+
+void renderQueueClear (struct RenderQueue &queue)
+{
+	queue.items.clear();
+}
+
+void renderQueuePush (struct RenderQueue &queue, const struct RenderItem &item)
+{
+	queue.items.push_back(item);
+}
+
+void renderQueueSort (struct RenderQueue &queue)
+{
+	size_t n = queue.items.size();
+	if (n < 2)
+		return;
+	queue.scratch.resize(n);
+
+	struct RenderItem* src = &queue.items[0];
+	struct RenderItem* dst = &queue.scratch[0];
+
+	for (int shift = 0; shift < 64; shift += 8) {
+		size_t count[256];
+		memset(count, 0, sizeof(count));
+		for (size_t i=0; i<n; i++)
+			count[(src[i].key >> shift) & 0xff]++;
+
+		// every key has the same byte here, the pass would not move anything
+		if (count[(src[0].key >> shift) & 0xff] == n)
+			continue;
+
+		size_t offset = 0;
+		for (int b=0; b<256; b++) {
+			size_t c = count[b];
+			count[b] = offset;
+			offset += c;
+		}
+		for (size_t i=0; i<n; i++)
+			dst[count[(src[i].key >> shift) & 0xff]++] = src[i];
+
+		struct RenderItem* t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if (src != &queue.items[0])
+		queue.items.swap(queue.scratch);
+}
@@ -0,0 +1,39 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <stdint.h>
+#include <vector>
+#include <glad/glad.h>
+
+struct VAO;
+
+/* One queued draw. key decides the submission order, the rest is what
+   the submitter needs to issue it. */
+struct RenderItem {
+	uint64_t key;
+	struct VAO* vao;
+	float x, y, z;           // model translation
+	int slot;                // Transforms slot, -1 for the per-draw MVP path
+	const GLfloat* instances; // per-instance translations, NULL if not instanced
+	GLuint instanceBuffer;    // static buffer of translations used when instances is NULL, 0 if none
+	int numInstances;
+};
+
+/* Sort key layout, most significant first:
+     8 bits program | 1 bit fill mode | 23 bits VAO | 32 bits depth
+   so each program and each fill mode is set once per frame, draws of the
+   same VAO are adjacent, and they go front to back within a VAO. */
+uint64_t renderKey (GLuint program, GLenum fill_mode, GLuint vao, float depth);
+
+struct RenderQueue {
+	std::vector<struct RenderItem> items;
+	std::vector<struct RenderItem> scratch; // radix sort ping-pong buffer
+};
+
+void renderQueueClear (struct RenderQueue &queue);
+void renderQueuePush (struct RenderQueue &queue, const struct RenderItem &item);
+
+/* LSD radix sort on the 64-bit keys, stable, skipping bytes all keys share */
+void renderQueueSort (struct RenderQueue &queue);
+
+#endif
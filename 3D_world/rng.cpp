@@ -0,0 +1,34 @@
+#include "rng.h"
+
+void rngSeed (struct Rng &rng, uint64_t seed)
+{
+	rng.state = 0;
+	rng.inc = (seed << 1) | 1;
+	rngNext(rng);
+	rng.state += seed;
+	rngNext(rng);
+}
+
+uint32_t rngNext (struct Rng &rng)
+{
+	uint64_t old = rng.state;
+	rng.state = old*6364136223846793005ULL + rng.inc;
+	uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+	uint32_t rot = (uint32_t)(old >> 59);
+	return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+}
+
+uint32_t rngBelow (struct Rng &rng, uint32_t bound)
+{
+	// Lemire's multiply-shift, redrawing only in the rare biased low range
+	uint64_t m = (uint64_t)rngNext(rng) * bound;
+	uint32_t low = (uint32_t)m;
+	if (low < bound) {
+		uint32_t threshold = (-bound) % bound;
+		while (low < threshold) {
+			m = (uint64_t)rngNext(rng) * bound;
+			low = (uint32_t)m;
+		}
+	}
+	return (uint32_t)(m >> 32);
+}
@@ -0,0 +1,19 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* PCG32 (O'Neill): 64 bit state, 32 bit output, small and fast. The same seed
+   always gives the same sequence, on every platform. */
+struct Rng {
+	uint64_t state;
+	uint64_t inc; // stream, must be odd
+};
+
+void rngSeed (struct Rng &rng, uint64_t seed);
+uint32_t rngNext (struct Rng &rng);
+
+/* Uniform in [0, bound) without modulo bias; bound must be > 0 */
+uint32_t rngBelow (struct Rng &rng, uint32_t bound);
+
+#endif
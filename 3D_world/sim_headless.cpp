@@ -0,0 +1,173 @@
+/* The simulation alone, with no window and no GL, ticking as fast as it can
+   on the simulated clock. A seeded bot plays; each game that ends is
+   restarted with the next seed. Prints the tick rate at the end.
+   With --record the bot's game is saved for replay, with --replay a recording
+   plays instead of the bot; either way only one game is played.
+   Build with "make sim_headless" and run ./sim_headless --ticks 100000 */
+
+#include "simulation.h"
+#include "rng.h"
+#include "profiler.h"
+#include "input_record.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+#define BOT_PERIOD 6 // ticks between bot key presses, about the keyboard repeat rate
+
+static double seconds ()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* Mostly heads for the goal corner, sometimes steps aside or jumps */
+static void botInput (struct Rng &rng, struct InputEvent &event)
+{
+	event.action = INPUT_PRESS;
+	int roll = rngBelow(rng, 20);
+	if (roll == 0)
+		event.key = INPUT_JUMP;
+	else if (roll < 4)
+		event.key = roll == 1 ? INPUT_LEFT : INPUT_DOWN;
+	else
+		event.key = rngBelow(rng, 2) ? INPUT_RIGHT : INPUT_UP;
+}
+
+int main (int argc, char** argv)
+{
+	long ticks = 100000;
+	const char* world = NULL;
+	const char* trace = NULL;
+	const char* record = NULL;
+	const char* replay_path = NULL;
+	Seed = 1;
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i], "--ticks") == 0 && i+1 < argc)
+			ticks = atol(argv[++i]);
+		else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc)
+			Seed = strtoull(argv[++i], NULL, 10);
+		else if (strcmp(argv[i], "--grid") == 0 && i+1 < argc) {
+			if (sscanf(argv[++i], "%dx%d", &Grid_width, &Grid_depth) != 2 || !gridSizeValid(Grid_width, Grid_depth)) {
+				fprintf(stderr, "--grid takes WIDTHxDEPTH, from %dx%d to %dx%d\n", GRID_MIN, GRID_MIN, GRID_MAX, GRID_MAX);
+				return 1;
+			}
+		}
+		else if (strcmp(argv[i], "--world") == 0 && i+1 < argc)
+			world = argv[++i];
+		else if (strcmp(argv[i], "--trace") == 0 && i+1 < argc)
+			trace = argv[++i], Profiling = 1;
+		else if (strcmp(argv[i], "--record") == 0 && i+1 < argc)
+			record = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i+1 < argc)
+			replay_path = argv[++i];
+		else {
+			fprintf(stderr, "usage: %s [--ticks N] [--seed N] [--grid WxD] [--world file] [--trace trace.json]"
+				" [--record input.rec | --replay input.rec]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (record != NULL && replay_path != NULL) {
+		fprintf(stderr, "--record and --replay can't be combined\n");
+		return 1;
+	}
+	struct InputReplay replay;
+	if (replay_path != NULL) {
+		if (!replayLoad(replay, replay_path)) {
+			fprintf(stderr, "Could not read the recording %s\n", replay_path);
+			return 1;
+		}
+		Seed = replay.seed;
+		Grid_width = replay.width;
+		Grid_depth = replay.depth;
+		ticks = replay.endTick;
+	}
+	if (world != NULL && !openWorld(world)) {
+		fprintf(stderr, "Could not open or create %s\n", world);
+		return 1;
+	}
+	if (replay_path != NULL && (Grid_width != replay.width || Grid_depth != replay.depth)) {
+		fprintf(stderr, "%s is %dx%d but the recording was made on %dx%d\n", world, Grid_width, Grid_depth, replay.width, replay.depth);
+		return 1;
+	}
+	struct InputRecorder recorder;
+	recorder.file = NULL;
+	if (record != NULL && !recordOpen(recorder, record, Seed, Grid_width, Grid_depth)) {
+		fprintf(stderr, "Could not create %s\n", record);
+		return 1;
+	}
+	int single = record != NULL || replay_path != NULL;
+
+	uint64_t first_seed = Seed;
+	struct Rng bot;
+	rngSeed(bot, Seed ^ 0x9e3779b97f4a7c15ull);
+	zero();
+	profileThreadName("simulation");
+
+	vector<double> tick_times(ticks);
+	int won = 0, lost = 0;
+	double sim_seconds = 0;
+	double start = seconds();
+	for (long k=0; k<ticks; k++) {
+		double tick_start = seconds();
+		profileBegin("tick");
+		struct InputEvent event;
+		if (replay_path != NULL) {
+			while (replayNext(replay, Sim_tick, event))
+				applyInput(event);
+		}
+		else if (k % BOT_PERIOD == 0) {
+			botInput(bot, event);
+			applyInput(event);
+			recordEvent(recorder, Sim_tick, event);
+		}
+		simulationStep();
+		profileEnd();
+		tick_times[k] = seconds() - tick_start;
+		if (replay_path == NULL && (Player_lost || Player_win)) {
+			won += Player_win;
+			lost += Player_lost;
+			if (single) {
+				ticks = k+1;
+				break;
+			}
+			sim_seconds += Sim_time;
+			Seed++;
+			zero();
+		}
+	}
+	double wall = seconds() - start;
+	sim_seconds += Sim_time;
+	if (trace != NULL && !profileWriteTrace(trace))
+		fprintf(stderr, "Could not write %s\n", trace);
+	if (replay_path != NULL) {
+		won = Player_win;
+		lost = Player_lost;
+	}
+	if (record != NULL) {
+		int events = recorder.events;
+		if (recordClose(recorder, Sim_tick))
+			printf("Recorded %d input events over %ld ticks to %s\n", events, Sim_tick, record);
+		else
+			fprintf(stderr, "Could not write %s\n", record);
+	}
+	if (single)
+		printf("State at tick %ld: %016llx\n", Sim_tick, (unsigned long long)simulationHash());
+	if (ticks == 0)
+		return 0;
+
+	tick_times.resize(ticks); // a single game can stop before --ticks
+	sort(tick_times.begin(), tick_times.end());
+	printf("Grid %dx%d, seeds %llu..%llu: %d won, %d lost\n", Grid_width, Grid_depth,
+		(unsigned long long)first_seed, (unsigned long long)Seed, won, lost);
+	printf("%ld ticks in %.3f s: %.0f ticks/s, %.1fx real time (%.1f simulated seconds)\n",
+		ticks, wall, ticks/wall, sim_seconds/wall, sim_seconds);
+	printf("Per tick: mean %.3f us, median %.3f us, p99 %.3f us, max %.3f us\n",
+		1e6*wall/ticks, 1e6*tick_times[ticks/2], 1e6*tick_times[min(ticks-1, ticks*99/100)], 1e6*tick_times[ticks-1]);
+	return 0;
+}
@@ -0,0 +1,410 @@
+#include "simulation.h"
+#include "collision.h"
+#include "timeline.h"
+#include "oscillate.h"
+#include "rng.h"
+#include "profiler.h"
+
+#include <cmath>
+#include <algorithm>
+
+using namespace std;
+
+int Grid_width=10, Grid_depth=10;
+
+// one bit per cell, sized in zero()
+struct BitGrid Block_flag; // moving block, drawn raised by Block_move
+
+struct BitGrid Block_dis_flag; // hole the player falls through
+
+// the moving blocks only, in cell order, as parallel arrays for oscillateStep;
+// idle cells sit at height 0 and take no memory or time
+std::vector<int> Block_cells;
+std::vector<float> Block_move;
+std::vector<float> Block_direction; // +1 rising, -1 sinking, 0 once back down; see oscillate.h
+std::vector<int> Block_finished; // positions in the arrays that came back down this tick
+unsigned Blocks_version=0;
+float Block_rand=1;
+struct BitGrid obstacles_flag;
+unsigned Obstacles_version=0;
+struct BitGrid Free_cells; // scratch for placement queries
+
+float Player_X=0, Player_Y=0, Player_Z=0, Player_jump=0;
+int Player_fall=0;
+int Player_lost=0;
+int Player_win=0;
+int Block_count=5;
+
+struct Rng World_rng; // every random choice in the world, seeded from Seed in zero()
+uint64_t Seed=0; // --seed; picked from the clock when not given
+struct ChunkStore World_store;
+
+double Sim_time=0;
+long Sim_tick=0;
+double last_update_time=0, current_time; // obstacle reshuffles
+float u=2.0, g=1.0; // jump speed and gravity
+struct Timeline Animations; // jumps and falls; blocks oscillate in their own kernel
+
+// timeline tags
+#define TRACK_JUMP 1
+#define TRACK_FALL 2
+#define FALL_DEPTH 12.0f
+#define FALL_SECONDS 1.0f
+
+/* The player collides as a point, so it touches one cell, or two to four on an edge */
+struct CellRange playerCells ()
+{
+	return cellRange(Player_X, Player_X, Player_Z, Player_Z, Grid_width, Grid_depth);
+}
+
+int worldHole (int i, int j)
+{
+	if(World_store.map != NULL)
+		return *chunkStoreCell(World_store, i, j) & CELL_HOLE;
+	return bitGet(Block_dis_flag, i, j);
+}
+
+#define PLAYER_STEP 0.2f // distance moved per arrow key event
+
+void startJump ();
+void startFall ();
+
+/* Moving blocks are solid: sweep the player against them so it stops at the
+   face it runs into and slides along it, however long the step */
+void movePlayer(float dx, float dz)
+{
+	collisionSweep(Block_flag, 0, 0, &Player_X, &Player_Z, dx, dz);
+}
+
+
+void check_Player_fall()
+{
+	int i, j, hole=0;
+	struct CellRange r = playerCells();
+	if(World_store.map != NULL)
+	{
+		for(i=r.i0;i<=r.i1;i++)
+			for(j=r.j0;j<=r.j1;j++)
+				hole |= worldHole(i, j);
+	}
+	else
+		hole = collisionFind(Block_dis_flag, r, &i, &j);
+	if(Player_Y <=0.1 && hole)
+	{
+		// printf("Player(X,Z):  (%f,%f)\t BLOCK: (%d,%d)\n",Player_X,Player_Z,i,j);
+		startFall();
+	}
+}
+
+void check_player_obstacle()
+{
+	int i, j;
+	if(Player_Y<=0.1 && collisionFind(obstacles_flag, playerCells(), &i, &j))
+	{
+		startFall();
+	}
+}
+
+void applyInput (const struct InputEvent &event)
+{
+	if (Player_fall)
+		return; // no control while falling
+	if (event.action == INPUT_PRESS || event.action == INPUT_REPEAT)
+	{
+		switch (event.key)
+		{
+			case INPUT_UP:
+				movePlayer(0, -PLAYER_STEP);
+				break;
+			case INPUT_DOWN:
+				movePlayer(0, PLAYER_STEP);
+				break;
+			case INPUT_LEFT:
+				movePlayer(-PLAYER_STEP, 0);
+				break;
+			case INPUT_RIGHT:
+				movePlayer(PLAYER_STEP, 0);
+				break;
+			case INPUT_JUMP:
+				if (event.action == INPUT_PRESS)
+				{
+					if (!Player_jump)
+						startJump();
+					check_Player_fall();
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	// stay on the grid; the goal is the far corner cell
+	if(Player_X >Grid_width-0.2)
+		Player_X=Grid_width-0.21;
+	else if(Player_X <0)
+		Player_X=0.01;
+	if(Player_Z >0)
+		Player_Z=-0.01;
+	else if(Player_Z <-(Grid_depth-0.2))
+		Player_Z=-(Grid_depth-0.21);
+	check_Player_fall();
+	check_player_obstacle();
+	if(Player_X>=Grid_width-0.5 && Player_Z <=-(Grid_depth-0.5))
+	{
+		Player_win=1;
+	}
+	// printf("Player_X:   %f  Player_Z:  %f   \n",Player_X,Player_Z);
+}
+
+/* Jumps used to add u*t/20 - g*t*t/40 to Player_Y every frame, with t going up
+   by 0.05 a frame. Summed over n ticks that is the cubic below, which lands
+   where it comes back down through zero. */
+void startJump ()
+{
+	float a = u*0.05f/20.0f, b = g*0.05f*0.05f/40.0f;
+	float c1 = -(a/2 + b/6), c2 = (a + b)/2, c3 = -b/3;
+	float land = (-c2 - sqrt(c2*c2 - 4*c3*c1)) / (2*c3); // larger root of c3*n^2 + c2*n + c1
+	Player_jump=1;
+	timelineAddCurve(Animations, TRACK_JUMP, &Player_Y, 0, c1, c2, c3, SIM_HZ, land, 0);
+}
+
+void startFall ()
+{
+	if(Player_fall)
+		return;
+	Player_fall=1;
+	Player_jump=0;
+	timelineCancel(Animations, TRACK_JUMP);
+	timelineAddCurve(Animations, TRACK_FALL, &Player_Y, Player_Y, -FALL_DEPTH/FALL_SECONDS, 0, 0, 1, FALL_SECONDS, Player_Y-FALL_DEPTH);
+}
+
+/* Merge the cells of a new wave into the moving arrays, rising from 0 */
+static void startBlocks (const int* pi, const int* pj, int count)
+{
+	static vector<int> cells;
+	cells.resize(count);
+	for(int p=0;p<count;p++)
+		cells[p]=cellIndex(pi[p], pj[p]);
+	sort(cells.begin(), cells.end());
+
+	// from the back, so the old entries move at most once
+	long a=Block_cells.size()-1, b=count-1, k=Block_cells.size()+count-1;
+	Block_cells.resize(k+1);
+	Block_move.resize(k+1);
+	Block_direction.resize(k+1);
+	for(;b>=0;k--)
+	{
+		if(a>=0 && Block_cells[a]>cells[b])
+		{
+			Block_cells[k]=Block_cells[a];
+			Block_move[k]=Block_move[a];
+			Block_direction[k]=Block_direction[a];
+			a--;
+		}
+		else
+		{
+			Block_cells[k]=cells[b];
+			Block_move[k]=0;
+			Block_direction[k]=1;
+			b--;
+		}
+	}
+	Blocks_version++;
+}
+
+/* Drop the blocks that came back down, keeping the rest in cell order */
+static void stopBlocks ()
+{
+	size_t kept=0;
+	for(size_t k=0;k<Block_cells.size();k++)
+	{
+		if(Block_direction[k]==0)
+		{
+			bitSet(Block_flag, Block_cells[k]/Grid_depth, Block_cells[k]%Grid_depth, 0);
+			continue;
+		}
+		Block_cells[kept]=Block_cells[k];
+		Block_move[kept]=Block_move[k];
+		Block_direction[kept]=Block_direction[k];
+		kept++;
+	}
+	Block_cells.resize(kept);
+	Block_move.resize(kept);
+	Block_direction.resize(kept);
+	Blocks_version++;
+}
+
+/* Advance the world by one SIM_DT tick */
+void simulationStep ()
+{
+	int r1,r2;
+	if(Block_rand == 1)
+	{
+		// a wave of distinct inner cells (5 per 100) that hold neither a block nor an obstacle
+		static vector<int> pi, pj;
+		int wave = max(1, 5*Grid_width*Grid_depth/100);
+		pi.resize(wave);
+		pj.resize(wave);
+		bitGridFree(Free_cells, Block_flag, obstacles_flag, 1, Grid_width-2, 1, Grid_depth-2);
+		int placed = bitGridSample(Free_cells, wave, World_rng, &pi[0], &pj[0]);
+		for(int p=0;p<placed;p++)
+			bitSet(Block_flag, pi[p], pj[p], 1);
+		if(placed>0)
+			startBlocks(&pi[0], &pj[0], placed);
+		// a new wave starts when all of these are back down; with no room, try again next tick
+		Block_count=placed;
+		Block_rand = (placed == 0);
+	}
+
+	// every moving block rises to 2.0 and sinks back at the old 0.01 a frame
+	profileBegin("oscillate");
+	Block_finished.clear();
+	if(!Block_cells.empty())
+		oscillateStep(&Block_move[0], &Block_direction[0], Block_move.size(), 0.01*SIM_HZ*SIM_DT, 0, 2.0, Block_finished);
+	profileEnd();
+	if(!Block_finished.empty())
+	{
+		stopBlocks();
+		Block_count-=Block_finished.size();
+		if(Block_count==0)
+			Block_rand=1;
+	}
+
+	timelineStep(Animations, SIM_DT);
+	for(size_t k=0;k<Animations.finished.size();k++)
+	{
+		if(Animations.finished[k] == TRACK_JUMP)
+			Player_jump=0;
+		else if(Animations.finished[k] == TRACK_FALL)
+			Player_lost=1;
+	}
+
+	// obstacles move every 10 simulated seconds
+	Sim_time += SIM_DT;
+	Sim_tick++;
+	current_time = Sim_time;
+	if((current_time - last_update_time) >= 10)
+	{
+		profileBegin("reshuffle obstacles");
+		bitGridClear(obstacles_flag);
+
+		for(int i=1;i<Grid_width-1;i++)
+		{
+			r1=rngBelow(World_rng, 2);
+			for(int j=0;j<r1;j++)
+			{
+				r2=rngBelow(World_rng, Grid_depth-2)+1;
+				if(!worldHole(i, r2) && !bitGet(Block_flag, i, r2))
+				{
+					bitSet(obstacles_flag, i, r2, 1);
+				}
+			}
+		}
+		last_update_time=current_time;
+		Obstacles_version++;
+		profileEnd();
+	}
+}
+
+/* FNV-1a over raw bytes */
+static uint64_t hashBytes (uint64_t hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for(size_t k=0;k<size;k++)
+		hash = (hash ^ bytes[k]) * 0x100000001b3ull;
+	return hash;
+}
+
+uint64_t simulationHash ()
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+	float player[4] = {Player_X, Player_Y, Player_Z, Player_jump};
+	int state[4] = {Player_fall, Player_lost, Player_win, Block_count};
+	hash = hashBytes(hash, player, sizeof(player));
+	hash = hashBytes(hash, state, sizeof(state));
+	hash = hashBytes(hash, &Sim_tick, sizeof(Sim_tick));
+	hash = hashBytes(hash, Block_cells.data(), Block_cells.size()*sizeof(int));
+	hash = hashBytes(hash, Block_move.data(), Block_move.size()*sizeof(float));
+	hash = hashBytes(hash, &Block_flag.bits[0], Block_flag.bits.size()*sizeof(uint64_t));
+	hash = hashBytes(hash, &obstacles_flag.bits[0], obstacles_flag.bits.size()*sizeof(uint64_t));
+	return hash;
+}
+
+/* Fill a freshly created world file: one inner cell in ten is a hole. Written a
+   chunk at a time and released behind, so generation never holds more than a
+   chunk of the world in memory. */
+void generateWorld()
+{
+	rngSeed(World_rng, Seed);
+	for(int ci=0;ci<World_store.chunksX;ci++)
+	{
+		for(int cj=0;cj<World_store.chunksZ;cj++)
+		{
+			unsigned char* cells = chunkData(World_store, ci, cj);
+			int i1 = min(CHUNK_SIZE, Grid_width-1-ci*CHUNK_SIZE), j1 = min(CHUNK_SIZE, Grid_depth-1-cj*CHUNK_SIZE);
+			for(int i=(ci==0);i<i1;i++)
+				for(int j=(cj==0);j<j1;j++)
+					if(rngBelow(World_rng, 10) == 0)
+						cells[i*CHUNK_SIZE + j] = CELL_HOLE;
+			chunkStoreRelease(World_store, ci, cj);
+		}
+	}
+}
+
+int openWorld (const char* path)
+{
+	if (chunkStoreOpen(World_store, path)) {
+		Grid_width = World_store.width;
+		Grid_depth = World_store.depth;
+		return 1;
+	}
+	if (!chunkStoreCreate(World_store, path, Grid_width, Grid_depth))
+		return 0;
+	generateWorld();
+	return 1;
+}
+
+void zero()
+{
+	Player_X=Player_Y=Player_Z=0;
+	Player_jump=0;
+	Player_fall=Player_lost=Player_win=0;
+	Block_rand=1;
+	Sim_time=last_update_time=0;
+	Sim_tick=0;
+	bitGridInit(Block_flag, Grid_width, Grid_depth);
+	if(World_store.map != NULL)
+		bitGridInit(Block_dis_flag, 0, 0); // the holes are in the world file
+	else
+		bitGridInit(Block_dis_flag, Grid_width, Grid_depth);
+	bitGridInit(obstacles_flag, Grid_width, Grid_depth);
+	bitGridInit(Free_cells, Grid_width, Grid_depth);
+	Block_cells.clear();
+	Block_move.clear();
+	Block_direction.clear();
+	Blocks_version++;
+	timelineClear(Animations);
+	rngSeed(World_rng, Seed);
+	for(int i=1;i<Grid_width-1;i++)
+	{
+		int r1=rngBelow(World_rng, 3);
+		for(int j=0;j<r1;j++)
+		{
+			int r2=rngBelow(World_rng, Grid_depth-2)+1;
+			if(!worldHole(i, r2) && !bitGet(Block_flag, i, r2))
+			{
+				bitSet(obstacles_flag, i, r2, 1);
+			}
+		}
+	}
+	Obstacles_version++;
+	if(World_store.map == NULL)
+	{
+		// distinct inner holes (10 per 100 cells), away from the obstacles
+		int count = max(1, Grid_width*Grid_depth/10);
+		vector<int> hi(count), hj(count);
+		bitGridFree(Free_cells, Block_dis_flag, obstacles_flag, 1, Grid_width-2, 1, Grid_depth-2);
+		int holes = bitGridSample(Free_cells, count, World_rng, &hi[0], &hj[0]);
+		for(int p=0;p<holes;p++)
+			bitSet(Block_dis_flag, hi[p], hj[p], 1);
+	}
+}
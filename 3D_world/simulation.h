@@ -0,0 +1,89 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <stdint.h>
+#include <vector>
+#include "occupancy.h"
+#include "chunk_store.h"
+#include "input_queue.h"
+
+/* The game world and its fixed-step update: movement, collisions, the block
+   waves, obstacle reshuffles and the win/lose state. There is no GL or
+   window code in here, so the same world runs in the game and in the
+   sim_headless target. Everything belongs to the thread calling simulationStep. */
+
+#define SIM_HZ 60 // ticks per second; the per-tick steps below were tuned as per-frame steps at 60 fps
+#define SIM_DT (1.0/SIM_HZ)
+
+// InputEvent.key: the player commands keyboard() makes of the arrow keys and space
+#define INPUT_UP 0
+#define INPUT_DOWN 1
+#define INPUT_LEFT 2
+#define INPUT_RIGHT 3
+#define INPUT_JUMP 4
+
+// InputEvent.action
+#define INPUT_RELEASE 0
+#define INPUT_PRESS 1
+#define INPUT_REPEAT 2
+
+extern int Grid_width, Grid_depth; // cells along x and along -z, set with --grid
+
+#define GRID_MIN 3     // a border cell on each side of one inner cell
+#define GRID_MAX 32768 // so cellIndex of the last cell still fits an int
+
+/* Whether width x depth is a grid --grid accepts */
+inline int gridSizeValid (long width, long depth)
+{
+	return width >= GRID_MIN && width <= GRID_MAX && depth >= GRID_MIN && depth <= GRID_MAX;
+}
+
+/* Index of cell (i,j) in the per-cell arrays */
+inline int cellIndex (int i, int j)
+{
+	return i*Grid_depth + j;
+}
+
+extern struct BitGrid Block_flag;     // moving block, drawn raised by Block_move
+extern struct BitGrid Block_dis_flag; // hole the player falls through
+extern struct BitGrid obstacles_flag;
+extern unsigned Obstacles_version; // bumped whenever obstacles_flag is laid out again
+extern std::vector<int> Block_cells;  // the moving blocks' cellIndex, ascending
+extern std::vector<float> Block_move; // their heights, parallel to Block_cells; idle cells are at 0
+extern unsigned Blocks_version;       // bumped whenever a block starts or stops moving
+
+extern float Player_X, Player_Y, Player_Z, Player_jump;
+extern int Player_fall; // falling, the game is lost once the fall animation ends
+extern int Player_lost, Player_win;
+
+extern uint64_t Seed; // --seed; picked from the clock when not given
+extern struct ChunkStore World_store; // map is NULL without --world, holes are then in Block_dis_flag
+extern double Sim_time; // simulated seconds
+extern long Sim_tick; // ticks since zero(), what recorded input is keyed on
+
+int worldHole (int i, int j);
+
+/* Map path as World_store, or create it from Grid_width x Grid_depth and Seed
+   if it doesn't exist; an existing world sets the grid size. 0 on failure. */
+int openWorld (const char* path);
+
+/* Start a game: lay out the world from Seed and put the player on the first cell */
+void zero ();
+
+/* Move the player by (dx, dz), stopping at the first moving block in the way */
+void movePlayer (float dx, float dz);
+
+/* Start a fall if the player stands on a hole / runs into an obstacle */
+void check_Player_fall ();
+void check_player_obstacle ();
+
+/* Apply one player command, then keep the player on the grid and check for falls and the goal */
+void applyInput (const struct InputEvent &event);
+
+/* Advance the world by one SIM_DT tick */
+void simulationStep ();
+
+/* Fingerprint of the whole world state, equal across runs only if they stayed in lockstep */
+uint64_t simulationHash ();
+
+#endif
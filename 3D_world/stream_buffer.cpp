@@ -0,0 +1,107 @@
+#include "stream_buffer.h"
+#include "gl_state.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+static double seconds ()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void streamBufferInit (struct StreamBuffer &stream, size_t size)
+{
+	stream.size = size;
+	stream.segmentSize = size / STREAM_FRAMES;
+	stream.segment = 0;
+	stream.head = 0;
+	for (int k=0; k<STREAM_FRAMES; k++)
+		stream.fences[k] = 0;
+	stream.stalls = 0;
+	stream.stallSeconds = 0;
+	stream.orphans = 0;
+	stream.bytes = 0;
+
+	glGenBuffers(1, &stream.buffer);
+	stateBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+}
+
+void streamBufferFrameBegin (struct StreamBuffer &stream)
+{
+	stream.segment = (stream.segment + 1) % STREAM_FRAMES;
+	stream.head = 0;
+
+	GLsync fence = stream.fences[stream.segment];
+	if (fence == 0)
+		return;
+
+	// poll first so a stall is only counted when we really have to wait
+	GLenum status = glClientWaitSync(fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		double start = seconds();
+		while (status == GL_TIMEOUT_EXPIRED)
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1ms
+		stream.stalls++;
+		stream.stallSeconds += seconds() - start;
+	}
+	glDeleteSync(fence);
+	stream.fences[stream.segment] = 0;
+}
+
+void streamBufferFrameEnd (struct StreamBuffer &stream)
+{
+	if (stream.fences[stream.segment] != 0)
+		glDeleteSync(stream.fences[stream.segment]);
+	stream.fences[stream.segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void* streamBufferMap (struct StreamBuffer &stream, size_t bytes, size_t alignment, size_t &offset)
+{
+	size_t start = (stream.head + alignment - 1) / alignment * alignment;
+	stateBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+
+	if (start + bytes > stream.segmentSize) {
+		// Out of room: orphan the storage. The driver hands out fresh memory,
+		// so the old fences no longer matter and every segment is free again.
+		// Grow it so the whole frame so far fits a segment, or every frame
+		// this size would orphan again.
+		while (stream.size / STREAM_FRAMES < start + bytes)
+			stream.size *= 2;
+		stream.segmentSize = stream.size / STREAM_FRAMES;
+		glBufferData(GL_ARRAY_BUFFER, stream.size, NULL, GL_STREAM_DRAW);
+		for (int k=0; k<STREAM_FRAMES; k++) {
+			if (stream.fences[k] != 0)
+				glDeleteSync(stream.fences[k]);
+			stream.fences[k] = 0;
+		}
+		stream.orphans++;
+		start = 0;
+	}
+
+	offset = stream.segment*stream.segmentSize + start;
+	stream.head = start + bytes;
+	stream.bytes += bytes;
+	void* p = glMapBufferRange(GL_ARRAY_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (p == NULL)
+		fprintf(stderr, "Stream buffer: could not map %lu bytes\n", (unsigned long)bytes);
+	return p;
+}
+
+void streamBufferUnmap (struct StreamBuffer &stream)
+{
+	stateBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+size_t streamBufferWrite (struct StreamBuffer &stream, const void* data, size_t bytes, size_t alignment)
+{
+	size_t offset = 0;
+	void* p = streamBufferMap(stream, bytes, alignment, offset);
+	if (p == NULL)
+		return offset;
+	memcpy(p, data, bytes);
+	streamBufferUnmap(stream);
+	return offset;
+}
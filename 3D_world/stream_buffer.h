@@ -0,0 +1,52 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <stddef.h>
+#include <glad/glad.h>
+
+/* Ring buffer for data rewritten every frame (instance translations, the
+   Transforms block, ...). The buffer is split into one segment per frame in
+   flight; a segment is written with unsynchronized mapping and fenced when
+   the frame is submitted, so the CPU only ever waits when the GPU is a full
+   ring behind. A frame that outgrows its segment orphans the storage and
+   grows it until the frame fits, so the next such frame doesn't. Orphaning
+   leaves anything written earlier in the frame in the old storage: ranges
+   bound from it (the Transforms block) have to be written and bound again,
+   which callers notice by orphans changing. */
+
+#define STREAM_FRAMES 3
+
+struct StreamBuffer {
+	GLuint buffer;
+	size_t size;         // whole buffer
+	size_t segmentSize;  // size / STREAM_FRAMES
+	int segment;         // segment written this frame
+	size_t head;         // next free byte inside the segment
+	GLsync fences[STREAM_FRAMES];
+
+	// counters, accumulated until the caller resets them
+	int stalls;          // times a segment was still in use by the GPU
+	double stallSeconds; // time spent waiting on those
+	int orphans;         // frames that overflowed and reallocated the storage
+	size_t bytes;        // bytes written
+};
+
+void streamBufferInit (struct StreamBuffer &stream, size_t size);
+
+/* Move to the next segment, waiting for the GPU to release it if it must */
+void streamBufferFrameBegin (struct StreamBuffer &stream);
+
+/* Fence everything written this frame; call after the frame's draws are issued */
+void streamBufferFrameEnd (struct StreamBuffer &stream);
+
+/* Reserve bytes (aligned) in this frame's segment and map them for writing.
+   The returned pointer is valid until streamBufferUnmap; NULL if GL refused
+   the mapping, in which case the caller skips the write and the unmap. */
+void* streamBufferMap (struct StreamBuffer &stream, size_t bytes, size_t alignment, size_t &offset);
+void streamBufferUnmap (struct StreamBuffer &stream);
+
+/* Map, copy and unmap in one go; returns the offset of the data in the buffer
+   (its contents are undefined if the mapping failed) */
+size_t streamBufferWrite (struct StreamBuffer &stream, const void* data, size_t bytes, size_t alignment);
+
+#endif
@@ -0,0 +1,58 @@
+#include "timeline.h"
+
+void timelineClear (struct Timeline &timeline)
+{
+	timeline.tracks.clear();
+	timeline.finished.clear();
+}
+
+void timelineAddCurve (struct Timeline &timeline, int tag, float* value, float c0, float c1, float c2, float c3, float scale, float end, float rest)
+{
+	struct Track track = {};
+	track.kind = TRACK_CURVE;
+	track.tag = tag;
+	track.value = value;
+	track.c[0] = c0; track.c[1] = c1; track.c[2] = c2; track.c[3] = c3;
+	track.scale = scale;
+	track.end = end;
+	track.rest = rest;
+	timeline.tracks.push_back(track);
+	*value = c0;
+}
+
+void timelineCancel (struct Timeline &timeline, int tag)
+{
+	for (size_t k=0; k<timeline.tracks.size(); )
+		if (timeline.tracks[k].tag == tag) {
+			timeline.tracks[k] = timeline.tracks.back();
+			timeline.tracks.pop_back();
+		}
+		else
+			k++;
+}
+
+void timelineStep (struct Timeline &timeline, float dt)
+{
+	timeline.finished.clear();
+	for (size_t k=0; k<timeline.tracks.size(); ) {
+		struct Track &track = timeline.tracks[k];
+		track.time += dt;
+		int done = 0;
+		float s = track.scale*track.time;
+		if (s >= track.end) {
+			*track.value = track.rest;
+			done = 1;
+		}
+		else
+			*track.value = track.c[0] + s*(track.c[1] + s*(track.c[2] + s*track.c[3]));
+
+		// finished tracks are swapped out, the one moved into slot k is stepped next
+		if (done) {
+			timeline.finished.push_back(track.tag);
+			track = timeline.tracks.back();
+			timeline.tracks.pop_back();
+		}
+		else
+			k++;
+	}
+}
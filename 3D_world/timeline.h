@@ -0,0 +1,38 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <stddef.h>
+#include <vector>
+
+/* Animations that drive a float over simulated time. Every active track is
+   advanced in one pass per tick; nothing ever waits on an animation, the game
+   reacts to the tags of the tracks that finished instead. */
+
+#define TRACK_CURVE 0    // value = c0 + c1*s + c2*s^2 + c3*s^3 with s = scale*time, until s reaches end; then value = rest
+
+struct Track {
+	int kind;
+	int tag;      // caller's id, reported when the track finishes
+	float* value; // the animated variable
+	float time;   // seconds since the track started
+
+	float c[4];   // TRACK_CURVE
+	float scale, end, rest;
+};
+
+struct Timeline {
+	std::vector<struct Track> tracks;
+	std::vector<int> finished; // tags of the tracks that ended in the last timelineStep
+};
+
+void timelineClear (struct Timeline &timeline);
+
+void timelineAddCurve (struct Timeline &timeline, int tag, float* value, float c0, float c1, float c2, float c3, float scale, float end, float rest);
+
+/* Drop the tracks with this tag without reporting them as finished */
+void timelineCancel (struct Timeline &timeline, int tag);
+
+/* Advance every track by dt seconds and write the values */
+void timelineStep (struct Timeline &timeline, float dt);
+
+#endif
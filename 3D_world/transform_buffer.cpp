@@ -0,0 +1,53 @@
+#include "transform_buffer.h"
+#include "gl_state.h"
+
+#include <string.h>
+
+static GLfloat Block_data[16 + 4*MAX_TRANSFORMS]; // std140: VP, then a vec4 per translation
+static int Transform_count;
+static GLint Uniform_alignment = 256;
+
+static const int BLOCK_BYTES = sizeof(Block_data);
+
+void transformBufferInit (GLuint program)
+{
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &Uniform_alignment);
+
+	GLuint block = glGetUniformBlockIndex(program, "Transforms");
+	if (block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, TRANSFORM_BINDING);
+}
+
+void transformBufferBegin (const glm::mat4 &VP)
+{
+	memcpy(Block_data, &VP[0][0], 16*sizeof(GLfloat));
+	GLfloat* slot0 = &Block_data[16];
+	slot0[0] = slot0[1] = slot0[2] = slot0[3] = 0;
+	Transform_count = 1;
+}
+
+int transformBufferPush (float x, float y, float z)
+{
+	if (Transform_count >= MAX_TRANSFORMS)
+		return -1;
+	GLfloat* t = &Block_data[16 + 4*Transform_count];
+	t[0] = x;
+	t[1] = y;
+	t[2] = z;
+	t[3] = 0;
+	return Transform_count++;
+}
+
+void transformBufferUpload (struct StreamBuffer &stream)
+{
+	// The bound range has to cover the whole declared block, but only the
+	// slots used this frame are copied
+	size_t offset;
+	void* p = streamBufferMap(stream, BLOCK_BYTES, Uniform_alignment, offset);
+	if (p == NULL)
+		return;
+	memcpy(p, Block_data, (16 + 4*Transform_count)*sizeof(GLfloat));
+	streamBufferUnmap(stream);
+
+	stateBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM_BINDING, stream.buffer, offset, BLOCK_BYTES);
+}
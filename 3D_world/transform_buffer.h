@@ -0,0 +1,30 @@
+#ifndef TRANSFORM_BUFFER_H
+#define TRANSFORM_BUFFER_H
+
+#include <glad/glad.h>
+#define GLM_FORCE_RADIANS
+#include <glm/glm.hpp>
+#include "stream_buffer.h"
+
+/* Per-frame uniform block holding VP and one translation per drawn object.
+   Must match the Transforms block in Sample_GL.vert. Slot 0 is always the
+   zero translation, for draws whose model transform comes from elsewhere
+   (e.g. the instance attribute). */
+#define MAX_TRANSFORMS 1000 // 64 + 16*1000 bytes fits the 16KB minimum block size
+#define TRANSFORM_BINDING 0
+
+/* Attach the program's Transforms block to TRANSFORM_BINDING */
+void transformBufferInit (GLuint program);
+
+/* Start a frame: keep VP, forget last frame's translations */
+void transformBufferBegin (const glm::mat4 &VP);
+
+/* Reserve a slot for a translation, -1 when the buffer is full */
+int transformBufferPush (float x, float y, float z);
+
+/* Write VP and every translation pushed this frame into the stream in one
+   upload and bind that range as the Transforms block. Call again if the
+   stream orphans later in the frame, the bound range went with the old storage. */
+void transformBufferUpload (struct StreamBuffer &stream);
+
+#endif
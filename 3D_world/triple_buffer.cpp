@@ -0,0 +1,25 @@
+#include "triple_buffer.h"
+
+void tripleBufferInit (struct TripleBuffer &buffer)
+{
+	buffer.back = 0;
+	buffer.middle.store(1);
+	buffer.front = 2;
+}
+
+int tripleBufferPublish (struct TripleBuffer &buffer)
+{
+	// release: the slot's contents are written before the reader can take it
+	int old = buffer.middle.exchange(buffer.back | TRIPLE_BUFFER_FRESH, std::memory_order_acq_rel);
+	buffer.back = old & 3;
+	return buffer.back;
+}
+
+int tripleBufferAcquire (struct TripleBuffer &buffer)
+{
+	if (buffer.middle.load(std::memory_order_relaxed) & TRIPLE_BUFFER_FRESH) {
+		int old = buffer.middle.exchange(buffer.front, std::memory_order_acq_rel);
+		buffer.front = old & 3;
+	}
+	return buffer.front;
+}
@@ -0,0 +1,29 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+/* Hands the latest of a stream of values from one writer thread to one reader
+   thread without locks. The caller keeps three slots; the writer fills slot
+   `back`, the reader looks at slot `front`, and the third sits in the middle.
+   Publishing swaps back with the middle, acquiring swaps the middle with front
+   when something new was published, so neither side ever waits or sees a slot
+   the other one is using. */
+
+struct TripleBuffer {
+	std::atomic<int> middle; // slot index, plus TRIPLE_BUFFER_FRESH when unread
+	int back;  // owned by the writer
+	int front; // owned by the reader
+};
+
+#define TRIPLE_BUFFER_FRESH 4
+
+void tripleBufferInit (struct TripleBuffer &buffer);
+
+/* Writer: make slot `back` visible to the reader; returns the new back slot to fill */
+int tripleBufferPublish (struct TripleBuffer &buffer);
+
+/* Reader: the slot holding the latest published value (the same slot again if nothing new) */
+int tripleBufferAcquire (struct TripleBuffer &buffer);
+
+#endif
@@ -0,0 +1,129 @@
+#include "vertex_format.h"
+
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+/* IEEE 754 binary16, round to nearest, flushing values too small for a normal half to zero */
+unsigned short floatToHalf (float f)
+{
+	unsigned int x;
+	memcpy(&x, &f, sizeof(x));
+
+	unsigned int sign = (x >> 16) & 0x8000;
+	int exponent = (int)((x >> 23) & 0xff) - 127 + 15;
+	unsigned int mantissa = x & 0x7fffff;
+
+	if (((x >> 23) & 0xff) == 0xff)  // inf / nan
+		return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+	if (exponent >= 31)               // too large, clamp to inf
+		return sign | 0x7c00;
+	if (exponent <= 0)                // too small for a normal half
+		return sign;
+
+	unsigned int half = sign | (exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)            // round the dropped bits to nearest
+		half++;
+	return half;
+}
+
+static unsigned char colorToByte (float c)
+{
+	if (c < 0) c = 0;
+	if (c > 1) c = 1;
+	return (unsigned char) lround(c * 255.0f);
+}
+
+void vertexLayout (int format, struct VertexLayout &layout)
+{
+	if (format & VERTEX_POS_INT16) {
+		layout.positionType = GL_SHORT;
+		layout.positionNormalized = GL_TRUE;
+		layout.colorOffset = 8; // 3 shorts padded to 4 byte alignment
+	}
+	else if (format & VERTEX_POS_HALF) {
+		layout.positionType = GL_HALF_FLOAT;
+		layout.positionNormalized = GL_FALSE;
+		layout.colorOffset = 8;
+	}
+	else {
+		layout.positionType = GL_FLOAT;
+		layout.positionNormalized = GL_FALSE;
+		layout.colorOffset = 12;
+	}
+	layout.stride = layout.colorOffset + 4;
+}
+
+void packVertices (int format, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, struct PackedVertices &out)
+{
+	vertexLayout(format, out.layout);
+	out.positionScale = 1.0f;
+	if (format & VERTEX_POS_INT16) {
+		// normalized shorts cover [-1,1], so store position / largest coordinate
+		float maxabs = 0;
+		for (int i=0; i<3*numVertices; i++)
+			maxabs = fmax(maxabs, fabs(vertex_buffer_data[i]));
+		out.positionScale = maxabs > 0 ? maxabs : 1.0f;
+	}
+	const int stride = out.layout.stride;
+	const int colorOffset = out.layout.colorOffset;
+	const GLenum positionType = out.layout.positionType;
+
+	out.vertices.clear();
+	out.indices.clear();
+	out.numVertices = 0;
+
+	vector<unsigned int> indices;
+	unordered_map<string, unsigned int> seen;
+	vector<unsigned char> vertex(stride, 0);
+
+	for (int i=0; i<numVertices; i++) {
+		const GLfloat* p = vertex_buffer_data + 3*i;
+		const GLfloat* c = color_buffer_data + 3*i;
+
+		for (int k=0; k<3; k++) {
+			if (positionType == GL_SHORT) {
+				short q = (short) lround(p[k] / out.positionScale * 32767.0f);
+				memcpy(&vertex[2*k], &q, 2);
+			}
+			else if (positionType == GL_HALF_FLOAT) {
+				unsigned short h = floatToHalf(p[k]);
+				memcpy(&vertex[2*k], &h, 2);
+			}
+			else
+				memcpy(&vertex[4*k], &p[k], 4);
+			vertex[colorOffset + k] = colorToByte(c[k]);
+		}
+		vertex[colorOffset + 3] = 255;
+
+		if (format & VERTEX_INDEXED) {
+			// vertices are compared after quantization, so near-equal ones merge
+			string key((const char*) &vertex[0], stride);
+			auto it = seen.find(key);
+			if (it != seen.end()) {
+				indices.push_back(it->second);
+				continue;
+			}
+			seen[key] = out.numVertices;
+			indices.push_back(out.numVertices);
+		}
+		out.vertices.insert(out.vertices.end(), vertex.begin(), vertex.end());
+		out.numVertices++;
+	}
+
+	out.numIndices = indices.size();
+	if (out.numVertices <= 65536) {
+		out.indexType = GL_UNSIGNED_SHORT;
+		for (size_t i=0; i<indices.size(); i++) {
+			unsigned short s = indices[i];
+			out.indices.insert(out.indices.end(), (unsigned char*) &s, (unsigned char*) &s + 2);
+		}
+	}
+	else {
+		out.indexType = GL_UNSIGNED_INT;
+		out.indices.assign((unsigned char*) indices.data(), (unsigned char*) (indices.data() + indices.size()));
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <vector>
+#include <glad/glad.h>
+
+/* Vertex layout flags for create3DObject. Anything but VERTEX_SEPARATE puts
+   position and color into one interleaved VBO with RGBA8 normalized colors. */
+#define VERTEX_SEPARATE    0 // two float VBOs, unindexed (the original layout)
+#define VERTEX_INTERLEAVED 1 // one VBO: position + RGBA8 color
+#define VERTEX_INDEXED     2 // unique vertices plus an index buffer
+#define VERTEX_POS_INT16   4 // positions as normalized int16, scaled by PositionScale
+#define VERTEX_POS_HALF    8 // positions as half floats
+
+/* Where the attributes sit inside one interleaved vertex */
+struct VertexLayout {
+	int stride;
+	int colorOffset; // position is always at offset 0
+	GLenum positionType;
+	GLboolean positionNormalized;
+};
+
+struct PackedVertices {
+	struct VertexLayout layout;
+	std::vector<unsigned char> vertices; // interleaved position + color, layout.stride bytes each
+	std::vector<unsigned char> indices;  // empty unless VERTEX_INDEXED
+	int numVertices; // vertices stored in the VBO
+	int numIndices;
+	float positionScale; // multiply decoded positions by this
+	GLenum indexType;    // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+void vertexLayout (int format, struct VertexLayout &layout);
+
+/* Quantize, interleave and (if asked) deduplicate numVertices xyz/rgb float triples */
+void packVertices (int format, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, struct PackedVertices &out);
+
+unsigned short floatToHalf (float f);
+
+#endif